@@ -0,0 +1,432 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * Micro-benchmark for the loudnorm hot path.
+ *
+ * Runs the LoudnormProcessor the element wraps on every buffer (loudness
+ * measurement with the gain computation and smoothing, then the gain
+ * apply) over synthetic signals and a range of buffer sizes, without a pipeline
+ * around it, and reports where the time goes. The ebur128 column is the
+ * cost of measuring the same buffers with libebur128 short-term and
+ * momentary queries instead, for comparison. After each signal the
+ * integrated loudness, LRA and the short-term and momentary loudness
+ * over time of the meter are checked against libebur128 at full rate.
+ * -m runs the meter at a reduced rate like the measure-rate property,
+ * -l puts the lookahead limiter (at -1 dBFS) behind the gain.
+ *
+ *   make bench
+ *   build/loudnorm-bench -f f32 -c 2 -r 44100 -s 20
+ *   build/loudnorm-bench -m 16000
+ *   build/loudnorm-bench -l 5
+ */
+
+#include <ebur128.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/loudnormgain.h"
+#include "../src/loudnormmeter.h"
+#include "../src/loudnormprocessor.h"
+
+#define MIN_MEASURE_RATE 8000
+
+typedef enum {
+  FORMAT_S16,
+  FORMAT_S32,
+  FORMAT_F32
+} Format;
+
+static const char *format_names[] = { "s16", "s32", "f32" };
+static const LoudnormFormat processor_formats[] =
+    { LOUDNORM_FORMAT_S16, LOUDNORM_FORMAT_S32, LOUDNORM_FORMAT_F32 };
+static const size_t format_sizes[] = { 2, 4, 4 };
+
+typedef enum {
+  SIGNAL_SPEECH,
+  SIGNAL_TONAL,
+  SIGNAL_SILENCE
+} Signal;
+
+static const char *signal_names[] = { "speech", "tonal", "silence" };
+
+static const size_t buffer_sizes[] =
+    { 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384 };
+
+typedef struct {
+  double total_ns;
+  double meter_ns;
+  double ebur128_ns;
+  double gain_ns;
+  size_t buffers;
+} Result;
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* xorshift, the signals must be identical on every run and platform */
+static uint32_t
+next_random (uint32_t * state)
+{
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/* Fills frames * channels samples in [-1, 1] */
+static void
+generate_signal (Signal signal, float *out, size_t frames, int channels,
+    int rate)
+{
+  uint32_t seed = 0x12345678;
+  double lp = 0.0, hp = 0.0;
+
+  for (size_t i = 0; i < frames; i++) {
+    double t = (double) i / rate;
+    double v = 0.0;
+
+    switch (signal) {
+      case SIGNAL_SPEECH:{
+        /* band limited noise with a ~4 Hz syllable envelope and pauses */
+        double noise = (next_random (&seed) / 4294967296.0) * 2.0 - 1.0;
+        double env = 0.5 - 0.5 * cos (2 * M_PI * 4.0 * t);
+        double phrase = fmod (t, 3.0) < 2.2 ? 1.0 : 0.02;
+
+        lp += 0.15 * (noise - lp);
+        hp += 0.01 * (lp - hp);
+        v = 2.5 * (lp - hp) * env * phrase;
+        break;
+      }
+      case SIGNAL_TONAL:
+        v = 0.3 * sin (2 * M_PI * 440.0 * t) +
+            0.1 * sin (2 * M_PI * 880.0 * t) +
+            0.05 * sin (2 * M_PI * 1320.0 * t);
+        break;
+      case SIGNAL_SILENCE:
+        v = 0.0;
+        break;
+    }
+
+    if (v > 1.0)
+      v = 1.0;
+    else if (v < -1.0)
+      v = -1.0;
+    for (int c = 0; c < channels; c++)
+      out[i * channels + c] = (float) v;
+  }
+}
+
+static void *
+convert_signal (const float *in, size_t samples, Format format)
+{
+  void *out = malloc (samples * format_sizes[format]);
+
+  for (size_t i = 0; i < samples; i++) {
+    switch (format) {
+      case FORMAT_S16:
+        ((int16_t *) out)[i] = (int16_t) lrintf (in[i] * 32767.0f);
+        break;
+      case FORMAT_S32:
+        ((int32_t *) out)[i] = (int32_t) lrint (in[i] * 2147483647.0);
+        break;
+      case FORMAT_F32:
+        ((float *) out)[i] = in[i];
+        break;
+    }
+  }
+  return out;
+}
+
+static void
+add_frames (ebur128_state * st, Format format, const void *data,
+    size_t frames)
+{
+  switch (format) {
+    case FORMAT_S16:
+      ebur128_add_frames_short (st, data, frames);
+      break;
+    case FORMAT_S32:
+      ebur128_add_frames_int (st, data, frames);
+      break;
+    case FORMAT_F32:
+      ebur128_add_frames_float (st, data, frames);
+      break;
+  }
+}
+
+static void
+meter_add_frames (LoudnormMeter * meter, Format format, const void *data,
+    size_t frames)
+{
+  switch (format) {
+    case FORMAT_S16:
+      loudnorm_meter_add_s16 (meter, data, frames);
+      break;
+    case FORMAT_S32:
+      loudnorm_meter_add_s32 (meter, data, frames);
+      break;
+    case FORMAT_F32:
+      loudnorm_meter_add_f32 (meter, data, frames);
+      break;
+  }
+}
+
+/* Mirrors the per-buffer work of the element in realtime mode */
+static Result
+run (const void *input, size_t frames, Format format, int channels, int rate,
+    unsigned int factor, double lookahead, size_t buffer_frames)
+{
+  size_t bpf = format_sizes[format] * channels;
+  unsigned char *buf = malloc (buffer_frames * bpf);
+  LoudnormProcessor *processor =
+      loudnorm_processor_new (processor_formats[format], rate, channels,
+      factor);
+  ebur128_state *st = ebur128_init (channels, rate,
+      EBUR128_MODE_I | EBUR128_MODE_LRA);
+  Result r = { 0 };
+
+  loudnorm_processor_set_limiter (processor, lookahead, -1.0);
+
+  double start = now_ns ();
+
+  for (size_t pos = 0; pos + buffer_frames <= frames; pos += buffer_frames) {
+    double gain, t0, t1, t2;
+    int silent;
+
+    /* the copy stands in for upstream producing a new buffer */
+    memcpy (buf, (const unsigned char *) input + pos * bpf,
+        buffer_frames * bpf);
+
+    t0 = now_ns ();
+    gain = loudnorm_processor_measure (processor, buf, buffer_frames,
+        &silent);
+    t1 = now_ns ();
+
+    /* silence passes untouched with the gain frozen, or through the
+     * delay of the limiter */
+    if (!silent)
+      loudnorm_processor_apply (processor, buf, buf, buffer_frames, gain);
+    else if (lookahead > 0.0)
+      loudnorm_processor_apply (processor, buf, buf, buffer_frames, 0.0);
+    t2 = now_ns ();
+
+    r.meter_ns += t1 - t0;
+    r.gain_ns += t2 - t1;
+    r.buffers++;
+  }
+
+  r.total_ns = now_ns () - start;
+
+  /* the same measurement done by libebur128 */
+  for (size_t pos = 0; pos + buffer_frames <= frames; pos += buffer_frames) {
+    double shortterm, momentary, t0 = now_ns ();
+
+    add_frames (st, format, (const unsigned char *) input + pos * bpf,
+        buffer_frames);
+    ebur128_loudness_shortterm (st, &shortterm);
+    ebur128_loudness_momentary (st, &momentary);
+    r.ebur128_ns += now_ns () - t0;
+  }
+
+  loudnorm_processor_free (processor);
+  ebur128_destroy (&st);
+  free (buf);
+  return r;
+}
+
+/* Measures the whole signal with both and prints the difference, the
+ * short-term and momentary loudness every 100 ms where ebur128 is above
+ * its -70 LUFS gate */
+static void
+compare (const void *input, size_t frames, Format format, int channels,
+    int rate, unsigned int factor)
+{
+  LoudnormMeter *meter = loudnorm_meter_new_decimated (rate, channels,
+      factor);
+  ebur128_state *st = ebur128_init (channels, rate,
+      EBUR128_MODE_I | EBUR128_MODE_LRA);
+  size_t bpf = format_sizes[format] * channels, step = rate / 10, points = 0;
+  double integrated, range, meter_integrated, meter_range;
+  double sum_s = 0.0, sum_m = 0.0, max_s = 0.0, max_m = 0.0;
+
+  loudnorm_meter_enable_gating (meter);
+  for (size_t pos = 0; pos + step <= frames; pos += step) {
+    const unsigned char *data = (const unsigned char *) input + pos * bpf;
+    double shortterm, momentary, ds, dm;
+
+    meter_add_frames (meter, format, data, step);
+    add_frames (st, format, data, step);
+
+    ebur128_loudness_shortterm (st, &shortterm);
+    ebur128_loudness_momentary (st, &momentary);
+    if (shortterm <= -70.0 || momentary <= -70.0)
+      continue;
+
+    ds = fabs (loudnorm_meter_shortterm (meter) - shortterm);
+    dm = fabs (loudnorm_meter_momentary (meter) - momentary);
+    sum_s += ds;
+    sum_m += dm;
+    max_s = fmax (max_s, ds);
+    max_m = fmax (max_m, dm);
+    points++;
+  }
+
+  meter_integrated = loudnorm_meter_integrated (meter);
+  meter_range = loudnorm_meter_range (meter);
+  ebur128_loudness_global (st, &integrated);
+  ebur128_loudness_range (st, &range);
+
+  printf ("%-8s integrated %.2f LUFS (ebur128 %.2f, %+.3f LU), "
+      "LRA %.2f LU (ebur128 %.2f, %+.3f LU)\n", "", meter_integrated,
+      integrated, meter_integrated - integrated, meter_range, range,
+      meter_range - range);
+  if (points > 0)
+    printf ("%-8s short-term error mean %.3f max %.3f LU, "
+        "momentary error mean %.3f max %.3f LU\n", "", sum_s / points, max_s,
+        sum_m / points, max_m);
+
+  loudnorm_meter_free (meter);
+  ebur128_destroy (&st);
+}
+
+static void
+usage (const char *prog)
+{
+  fprintf (stderr, "usage: %s [-f s16|s32|f32] [-c channels] [-r rate] "
+      "[-s seconds] [-m measure-rate] [-l lookahead-ms]\n", prog);
+}
+
+int
+main (int argc, char **argv)
+{
+  Format format = FORMAT_S16;
+  int channels = 1, rate = 48000, measure_rate = 0, opt;
+  unsigned int factor = 1;
+  double seconds = 10.0, lookahead = 0.0;
+
+  while ((opt = getopt (argc, argv, "f:c:r:s:m:l:h")) != -1) {
+    switch (opt) {
+      case 'f':
+        if (strcmp (optarg, "s16") == 0)
+          format = FORMAT_S16;
+        else if (strcmp (optarg, "s32") == 0)
+          format = FORMAT_S32;
+        else if (strcmp (optarg, "f32") == 0)
+          format = FORMAT_F32;
+        else {
+          usage (argv[0]);
+          return 1;
+        }
+        break;
+      case 'c':
+        channels = atoi (optarg);
+        break;
+      case 'r':
+        rate = atoi (optarg);
+        break;
+      case 's':
+        seconds = atof (optarg);
+        break;
+      case 'm':
+        measure_rate = atoi (optarg);
+        break;
+      case 'l':
+        lookahead = atof (optarg);
+        break;
+      default:
+        usage (argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (channels < 1 || rate < 1 || seconds <= 0.0 || measure_rate < 0 ||
+      lookahead < 0.0) {
+    usage (argv[0]);
+    return 1;
+  }
+
+  /* same rounding as the element */
+  if (measure_rate > 0) {
+    if (measure_rate < MIN_MEASURE_RATE)
+      measure_rate = MIN_MEASURE_RATE;
+    if (rate / measure_rate > 1)
+      factor = rate / measure_rate;
+  }
+
+  size_t frames = (size_t) (seconds * rate);
+  size_t samples = frames * channels;
+  float *signal = malloc (samples * sizeof (float));
+
+  LoudnormMeter *meter = loudnorm_meter_new (rate, channels);
+
+  printf ("loudnorm-bench: %s, %d ch, %d Hz, %.1f s per run, %s gain kernel, "
+      "%s meter kernel at %d Hz\n", format_names[format], channels, rate,
+      seconds, loudnorm_gain_get_impl_name (),
+      loudnorm_meter_get_impl_name (meter), rate / (int) factor);
+  loudnorm_meter_free (meter);
+  printf ("%-8s %7s %10s %12s %12s %12s %7s %12s\n", "signal", "frames",
+      "ns/sample", "buffers/s", "meter ns", "gain ns", "gain %",
+      "ebur128 ns");
+
+  for (int s = SIGNAL_SPEECH; s <= SIGNAL_SILENCE; s++) {
+    generate_signal (s, signal, frames, channels, rate);
+    void *input = convert_signal (signal, samples, format);
+
+    for (size_t b = 0; b < sizeof (buffer_sizes) / sizeof (buffer_sizes[0]);
+        b++) {
+      size_t buffer_frames = buffer_sizes[b];
+      Result r = run (input, frames, format, channels, rate, factor,
+          lookahead, buffer_frames);
+      double processed = (double) r.buffers * buffer_frames * channels;
+
+      if (r.buffers == 0)
+        continue;
+
+      printf ("%-8s %7zu %10.2f %12.0f %12.2f %12.2f %6.1f%% %12.2f\n",
+          signal_names[s], buffer_frames,
+          (r.meter_ns + r.gain_ns) / processed,
+          r.buffers / (r.total_ns / 1e9),
+          r.meter_ns / processed, r.gain_ns / processed,
+          100.0 * r.gain_ns / (r.meter_ns + r.gain_ns),
+          r.ebur128_ns / processed);
+    }
+
+    if (s != SIGNAL_SILENCE)
+      compare (input, frames, format, channels, rate, factor);
+
+    free (input);
+  }
+
+  free (signal);
+  return 0;
+}
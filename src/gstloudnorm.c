@@ -19,17 +19,163 @@
 /**
  * SECTION:element-gstloudnorm
  *
- * The loudnorm element does loundness normalization on single channel.
+ * The loudnorm element does loundness normalization. It works natively on
+ * interleaved S16LE, S32LE and F32LE audio with any channel count, at
+ * 8 kHz and above, where the K-weighting of the meter still fits.
  *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
- * gst-launch-1.0 filesrc location=audio_3.wav ! wavparse ! audioconvert ! \
- *  audioresample ! 'audio/x-raw,format=S16LE,channels=1,rate=48000'! \
- *  loudnorm target-loudness=-23.0 ! audioconvert ! audioresample ! \
- *  autoaudiosink
+ * gst-launch-1.0 filesrc location=audio_3.wav ! wavparse ! \
+ *  loudnorm target-loudness=-23.0 ! audioconvert ! autoaudiosink
  * ]|
  * this pipeline will normalize the loudness of the audio_3.wav file to -23.0 LUFS
+ *
+ * In realtime mode the gain moves the gated mean short-term loudness of
+ * the last minute to target-loudness, and compresses the deviations from
+ * it when the loudness range of that minute exceeds target-lra. Until
+ * the first 3 s are measured the short-term loudness itself is pulled
+ * to the target.
+ *
+ * While the momentary loudness is below silent-threshold the gain is
+ * frozen and buffers go out untouched. Buffers without a sample that
+ * could reach the threshold are not even filtered, so idle streams cost
+ * little more than a scan for the peak.
+ *
+ * The settings can be changed while playing, from any thread and without
+ * a lock the streaming thread would wait for. New values of
+ * target-loudness, target-lra and measured-loudness reach the gain over
+ * ramp-time. Gain changes between buffers are spread across the buffer,
+ * so retuning a running stream makes no audible step.
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Limiting</title>
+ * Gains that push the peaks beyond full scale clip the samples. With
+ * limiter set a lookahead limiter keeps them below ceiling instead: it
+ * sees each peak lookahead ms in advance and lowers the gain in a ramp
+ * towards it, then lets it recover over 50 ms.
+ * |[
+ * gst-launch-1.0 filesrc location=audio_3.wav ! wavparse ! \
+ *  loudnorm target-loudness=-14 limiter=true lookahead=5 ceiling=-1 ! \
+ *  audioconvert ! autoaudiosink
+ * ]|
+ * The output is delayed by the lookahead. Buffers keep the time of the
+ * audio they hold, so they leave that much later than their timestamps,
+ * which the element adds to the latency query; the last frames are
+ * pushed out on EOS. While the limiter is on the element never goes into
+ * passthrough and silence runs through the delay as well. limiter,
+ * lookahead and ceiling are applied on the next caps.
+ *
+ * The limiter only sees the samples; between them the reconstructed
+ * signal can still peak higher once it is converted to analog or
+ * resampled. true-peak-ceiling holds those inter-sample peaks, measured
+ * at four times the rate as BS.1770 describes, below the given dBTP by
+ * lowering the gain of the buffers that would cross it, on the next caps
+ * as well. With async-measure the gain comes from earlier audio, the
+ * ceiling still checks it against the buffer it scales.
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Analysis metadata</title>
+ * Every buffer that leaves the element carries a #GstLoudnormMeta with
+ * the short-term and momentary loudness before the gain, the gain, the
+ * sample peak and whether the gain clipped, see gstloudnormmeta.h. Level
+ * meters and appsinks further down can read those instead of measuring
+ * the stream again:
+ * |[
+ * GstMeta *meta = gst_buffer_get_meta (buffer,
+ *     g_type_from_name (GST_LOUDNORM_META_API_NAME));
+ * ]|
+ * Only buffers that are shared in passthrough go without, as those can't
+ * be changed. The frames the limiter still holds on EOS go out with the
+ * last gain and their own peak.
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Two-pass normalization</title>
+ * For files the integrated loudness can be measured first and a single
+ * static gain applied afterwards:
+ * |[
+ * gst-launch-1.0 -m filesrc location=audio_3.wav ! wavparse ! \
+ *  loudnorm mode=analyze ! fakesink
+ * ]|
+ * posts a "loudnorm" element message with the integrated-loudness and
+ * loudness-range of the file on EOS. Pass the integrated loudness back in:
+ * |[
+ * gst-launch-1.0 filesrc location=audio_3.wav ! wavparse ! \
+ *  loudnorm mode=apply measured-loudness=-31.2 target-loudness=-23.0 ! \
+ *  wavenc ! filesink location=out.wav
+ * ]|
+ * The apply pass does no measurement and no smoothing at all.
+ *
+ * With cache-dir set the analyze pass also stores its results, keyed by
+ * the stream-id (or cache-key). When a later run finds the stream in the
+ * cache, analyze posts the cached results right away and skips the
+ * measurement, while realtime and apply use the cached integrated
+ * loudness as a static gain from the first buffer.
+ *
+ * Batch jobs don't need a pipeline at all: make batch builds
+ * loudnorm-batch, which runs the same measurement and gain over
+ * memory-mapped WAV files, several files in parallel. make lib builds
+ * the DSP core as libloudnorm.a, see loudnormprocessor.h.
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Long running streams</title>
+ * The realtime gain follows a fixed size short-term/momentary meter. The
+ * analyze pass by default keeps every gating block for integrated
+ * loudness and LRA though, so its memory grows with the stream. Set
+ * bounded-memory to gate with fixed histograms instead, or max-history to
+ * only measure the last part of the stream. The memory-footprint property
+ * reports the current estimate.
+ *
+ * Built with LOUDNORM_METER=internal the analyze pass is measured by the
+ * in-tree meter as well, which always gates with histograms, and
+ * libebur128 is not needed at all. bounded-memory, max-history and
+ * max-window have no effect then. make check compares the two meters on
+ * synthetic signals.
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Embedded CPUs</title>
+ * The gain is always applied at the stream rate, but the realtime meter
+ * can run at a fraction of it. With measure-rate=16000 a 48 kHz stream
+ * is measured on every third frame only, which cuts the measurement
+ * cost about threefold:
+ * |[
+ * gst-launch-1.0 alsasrc ! audio/x-raw,rate=48000 ! \
+ *  loudnorm measure-rate=16000 ! alsasink
+ * ]|
+ * The dropped frames are not lowpass filtered first. Content above half
+ * the measure rate folds down with its energy intact, which keeps the
+ * loudness within a few tenths of a LU on typical program material,
+ * except for tones landing near DC which the K-weighting removes.
+ * Sample peaks between the measured frames are missed. Analyze always
+ * measures at the stream rate.
+ *
+ * On the other end, wide streams can use more than one core. With
+ * measure-threads=4 a 16 channel stream is measured as four groups of 4
+ * channels on separate threads, with the same result. Waking the threads
+ * costs some microseconds per buffer, so this pays off for buffers of a
+ * few tens of milliseconds. The analyze pass of libebur128 stays serial.
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Restarts</title>
+ * A fresh realtime meter needs several seconds of audio before its
+ * short-term loudness and the gain settle. Streams that reconnect often
+ * can set state-location to a file instead: the element saves its
+ * loudness windows and smoothed gain there on EOS and stop, about 4 KB,
+ * and the next start restores them, so the first buffer already gets
+ * the gain the stream had.
+ * |[
+ * gst-launch-1.0 souphttpsrc location=http://example.com/live ! \
+ *  decodebin ! audioconvert ! \
+ *  loudnorm state-location=/var/lib/loudnorm/live.state ! autoaudiosink
+ * ]|
+ * The state does not depend on the rate or channel layout. Settings are
+ * not part of it, they come from the properties as usual.
  * </refsect2>
  */
 
@@ -40,7 +186,13 @@
 #include <gst/gst.h>
 #include <gst/audio/gstaudiofilter.h>
 #include "gstloudnorm.h"
+#include "gstloudnormmeta.h"
+#include "gstloudnormmux.h"
+#include "loudnormgain.h"
 #include <math.h> 
+#include <limits.h>
+#include <string.h>
+#include <time.h>
 
 GST_DEBUG_CATEGORY_STATIC (gst_loudnorm_debug_category);
 #define GST_CAT_DEFAULT gst_loudnorm_debug_category
@@ -57,114 +209,193 @@ static void gst_loudnorm_finalize (GObject * object);
 
 static gboolean gst_loudnorm_setup (GstAudioFilter * filter,
     const GstAudioInfo * info);
+static gboolean gst_loudnorm_stop (GstBaseTransform * trans);
+static gboolean gst_loudnorm_sink_event (GstBaseTransform * trans,
+    GstEvent * event);
+static gboolean gst_loudnorm_query (GstBaseTransform * trans,
+    GstPadDirection direction, GstQuery * query);
+static gboolean gst_loudnorm_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query);
+static gboolean gst_loudnorm_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+static GstFlowReturn gst_loudnorm_prepare_output_buffer (GstBaseTransform *
+    trans, GstBuffer * inbuf, GstBuffer ** outbuf);
+static GstFlowReturn gst_loudnorm_transform (GstBaseTransform * trans,
+    GstBuffer * inbuf, GstBuffer * outbuf);
 static GstFlowReturn gst_loudnorm_transform_ip (GstBaseTransform * trans,
     GstBuffer * buf);
 
-static void precomputeGaussianKernel(double* kernel);
-double gaussianFilter(Queue* queue, double* kernel);
-static void initQueue(Queue *queue);
-static float topQueue(Queue *queue);
-static void pushWithGaussianFilter(Queue* queue, double item, double* kernel); 
+static gboolean gst_loudnorm_start_analysis (GstLoudnorm * this);
+static guint64 gst_loudnorm_get_memory_footprint (GstLoudnorm * this);
+static void gst_loudnorm_stop_analysis (GstLoudnorm * this);
+static gboolean gst_loudnorm_shard_meter (GstLoudnorm * this);
+static void gst_loudnorm_stop_measure_pool (GstLoudnorm * this);
+
 
 enum
 {
   PROP_0,
   PROP_TARGET_LOUDNESS,
   PROP_TARGET_LRA,
-  PROP_SILENT_THRESHOLD
+  PROP_SILENT_THRESHOLD,
+  PROP_ASYNC_MEASURE,
+  PROP_UNITY_TOLERANCE,
+  PROP_MODE,
+  PROP_MEASURED_LOUDNESS,
+  PROP_INTEGRATED_LOUDNESS,
+  PROP_LOUDNESS_RANGE,
+  PROP_CACHE_DIR,
+  PROP_CACHE_KEY,
+  PROP_CACHE_TIMELINE,
+  PROP_ATTACK_TIME,
+  PROP_RELEASE_TIME,
+  PROP_STATS_INTERVAL,
+  PROP_STATS_BUFFERS,
+  PROP_STATS_SAMPLES,
+  PROP_STATS_EBUR128_TIME,
+  PROP_STATS_GAIN_TIME,
+  PROP_STATS_MAX_LATENCY,
+  PROP_STATS_CLIPPED_SAMPLES,
+  PROP_STATS_SHORTTERM_LOUDNESS,
+  PROP_STATS_MOMENTARY_LOUDNESS,
+  PROP_STATS_GAIN,
+  PROP_BOUNDED_MEMORY,
+  PROP_MAX_HISTORY,
+  PROP_MAX_WINDOW,
+  PROP_MEMORY_FOOTPRINT,
+  PROP_MEASURE_RATE,
+  PROP_MEASURE_THREADS,
+  PROP_RAMP_TIME,
+  PROP_LIMITER,
+  PROP_LOOKAHEAD,
+  PROP_CEILING,
+  PROP_TRUE_PEAK_CEILING,
+  PROP_STATE_LOCATION
 };
 
-/* Primitives to Gaussian Filter */
-static void precomputeGaussianKernel(double* kernel) {
-    double filterSum = 0.0;
-
-    // Calculate Gaussian kernel
-    for (int i = 0; i < FILTER_SIZE; i++) {
-        double x = i - (FILTER_SIZE - 1) / 2.0;
-        kernel[i] = exp(-0.5 * x / (FILTER_SIGMA * FILTER_SIGMA));
-        filterSum += kernel[i];
-    }
+#define DEFAULT_TARGET_LRA 7.0
+#define DEFAULT_ATTACK_TIME 100.0
+#define DEFAULT_RELEASE_TIME 500.0
+#define DEFAULT_SILENCE_THRESHOLD -50.0
+#define DEFAULT_RAMP_TIME 500.0
+/* dB, gain changes between buffers below that go in one step */
+#define MIN_GAIN_RAMP 0.01
+#define DEFAULT_LOOKAHEAD 5.0
+#define DEFAULT_CEILING -1.0
+#define DEFAULT_TRUE_PEAK_CEILING 0.0
+
+/* ebur128 refuses anything shorter while short-term and LRA are used */
+#define MIN_HISTORY_MS 3000
+#define MIN_WINDOW_MS 3000
+#define DEFAULT_WINDOW_MS 3000
+#define MIN_MEASURE_RATE LOUDNORM_METER_MIN_RATE
+
+/* Primitives for live settings. set_property stores the value and bumps
+ * params_serial, the streaming or analysis thread compares the serial at
+ * the start of each buffer and only then loads the values. Neither side
+ * takes a lock. */
 
-    // Normalize the kernel
-    for (int i = 0; i < FILTER_SIZE; i++) {
-        kernel[i] /= filterSum;
-    }
+static void
+params_set_float (gfloat * field, gfloat value)
+{
+  __atomic_store (field, &value, __ATOMIC_RELAXED);
 }
 
-double gaussianFilter(Queue* queue, double* kernel) {
-    double sum = 0.0;
-    int rear = queue->rear;
-    int size = queue->size;
+static gfloat
+params_get_float (gfloat * field)
+{
+  gfloat value;
 
-    // Apply Gaussian filter
-    for (int i = 0; i < FILTER_SIZE && i < size; i++) {
-        int index = (rear - i + QUEUE_SIZE) % QUEUE_SIZE;
-        sum += queue->data[index] * kernel[i];
-    }
+  __atomic_load (field, &value, __ATOMIC_RELAXED);
+  return value;
+}
 
-    return sum;
+static void
+params_publish (gint * serial, gfloat * field, gfloat value)
+{
+  params_set_float (field, value);
+  g_atomic_int_inc (serial);
 }
 
-/* Primitives for queue */
+/* Primitives for runtime statistics */
 
-static void initQueue(Queue *queue) {
-    queue->front = queue->rear = -1;
-    queue->size = 0;
-    // Initialize the queue with 0
-    for (int i = 0; i < QUEUE_SIZE; i++) {
-        queue->data[i] = 0.0;
-    }
-}
+#define STATS_GET(this, field) \
+    __atomic_load_n (&(this)->stats.field, __ATOMIC_RELAXED)
+#define STATS_SET(this, field, value) \
+    __atomic_store_n (&(this)->stats.field, (value), __ATOMIC_RELAXED)
+#define STATS_ADD(this, field, value) \
+    STATS_SET (this, field, (this)->stats.field + (value))
 
-static float topQueue(Queue *queue) {
-    return queue->data[queue->rear];
+static void
+stats_set_double (gdouble * field, gdouble value)
+{
+  __atomic_store (field, &value, __ATOMIC_RELAXED);
 }
 
-int isFull(Queue* queue) {
-    return queue->size == QUEUE_SIZE;
+static gdouble
+stats_get_double (gdouble * field)
+{
+  gdouble value;
+
+  __atomic_load (field, &value, __ATOMIC_RELAXED);
+  return value;
 }
 
-void enqueue(Queue* queue, double item) {
-    if (isFull(queue)) {
-        queue->front = (queue->front + 1) % QUEUE_SIZE;
-    } else {
-        queue->size++;
-    }
-    queue->rear = (queue->rear + 1) % QUEUE_SIZE;
-    queue->data[queue->rear] = item;
+static guint64
+stats_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (guint64) ts.tv_sec * GST_SECOND + ts.tv_nsec;
 }
 
-static void pushWithGaussianFilter(Queue* queue, double item, double* kernel) {
-    enqueue(queue, item);
-    if (queue->size < FILTER_SIZE) return;
-    double filteredItem = gaussianFilter(queue, kernel);
-    queue->data[queue->rear] = filteredItem;
+GType
+gst_loudnorm_mode_get_type (void)
+{
+  static GType mode_type = 0;
+  static const GEnumValue modes[] = {
+    {GST_LOUDNORM_MODE_REALTIME, "Adaptive gain from short-term loudness",
+        "realtime"},
+    {GST_LOUDNORM_MODE_ANALYZE, "Measure integrated loudness, pass through",
+        "analyze"},
+    {GST_LOUDNORM_MODE_APPLY, "Apply a static gain from measured-loudness",
+        "apply"},
+    {0, NULL, NULL}
+  };
+
+  if (!mode_type) {
+    mode_type = g_enum_register_static ("GstLoudnormMode", modes);
+  }
+  return mode_type;
 }
 
+/* How much audio the analysis ring can hold, in seconds */
+#define ANALYSIS_RING_SECONDS 2
+/* How long the analysis thread sleeps when the ring is empty */
+#define ANALYSIS_POLL_INTERVAL (5 * G_TIME_SPAN_MILLISECOND)
+
 /* pad templates */
 
+#define LOUDNORM_CAPS \
+    "audio/x-raw, " \
+    "format = (string) { F32LE, S32LE, S16LE }, " \
+    "channels = (int) [ 1, MAX ], " \
+    "rate = (int) [ 8000, MAX ], " \
+    "layout = (string) interleaved"
+
 static GstStaticPadTemplate gst_loudnorm_src_template =
 GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (
-    "audio/x-raw, "
-    "format = (string) S16LE, "
-    "channels = (int) 1, "
-    "rate = (int) 48000"
-    )
+    GST_STATIC_CAPS (LOUDNORM_CAPS)
   );
 
 static GstStaticPadTemplate gst_loudnorm_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (
-    "audio/x-raw, "
-    "format = (string) S16LE, "
-    "channels = (int) 1, "
-    "rate = (int) 48000"
-    )
+    GST_STATIC_CAPS (LOUDNORM_CAPS)
   );
 
 
@@ -204,31 +435,315 @@ gst_loudnorm_class_init (GstLoudnormClass * klass)
 
   g_object_class_install_property (gobject_class, PROP_TARGET_LRA,
       g_param_spec_float ("target-lra", "Target LRA",
-          "Target Loudness Range in LUFS", 1.0, 20.0, 7.0,
+          "Loudness range in LU the realtime gain holds the stream to",
+          1.0, 20.0, DEFAULT_TARGET_LRA,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
   g_object_class_install_property (gobject_class, PROP_SILENT_THRESHOLD,
       g_param_spec_float ("silent-threshold", "Silent Threshold",
-          "Silent Threshold in LUFS", -80.0, 0.0, -50.0,
+          "Momentary loudness in LUFS below which the realtime gain is "
+          "frozen and buffers pass untouched", -80.0, 0.0,
+          DEFAULT_SILENCE_THRESHOLD,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_ASYNC_MEASURE,
+      g_param_spec_boolean ("async-measure", "Async Measure",
+          "Measure loudness on a separate thread and apply the most recently "
+          "published gain on the streaming thread (applied on the next caps)",
+          FALSE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_UNITY_TOLERANCE,
+      g_param_spec_float ("unity-tolerance", "Unity Tolerance",
+          "Gain in dB below which buffers are passed through untouched "
+          "(0 = always rewrite)", 0.0, 6.0, 0.0,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MODE,
+      g_param_spec_enum ("mode", "Mode",
+          "Realtime AGC, or one of the passes of two-pass normalization",
+          GST_TYPE_LOUDNORM_MODE, GST_LOUDNORM_MODE_REALTIME,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MEASURED_LOUDNESS,
+      g_param_spec_float ("measured-loudness", "Measured Loudness",
+          "Integrated loudness of the input in LUFS, from an analyze pass "
+          "(mode=apply)", -99.0, 0.0, -23.0,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_INTEGRATED_LOUDNESS,
+      g_param_spec_double ("integrated-loudness", "Integrated Loudness",
+          "Integrated loudness of the stream in LUFS, set on EOS "
+          "(mode=analyze)", -HUGE_VAL, G_MAXDOUBLE, -HUGE_VAL,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_LOUDNESS_RANGE,
+      g_param_spec_double ("loudness-range", "Loudness Range",
+          "Loudness range of the stream in LU, set on EOS (mode=analyze)",
+          0.0, G_MAXDOUBLE, 0.0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_DIR,
+      g_param_spec_string ("cache-dir", "Cache Directory",
+          "Directory of the persistent analysis cache (NULL = disabled)",
+          NULL, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_KEY,
+      g_param_spec_string ("cache-key", "Cache Key",
+          "Key of the stream in the analysis cache, e.g. a content hash "
+          "(NULL = use the stream-id)",
+          NULL, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_TIMELINE,
+      g_param_spec_boolean ("cache-timeline", "Cache Timeline",
+          "Also store the momentary loudness every 100 ms in the cache",
+          FALSE, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_ATTACK_TIME,
+      g_param_spec_float ("attack-time", "Attack Time",
+          "Time constant in ms for the gain to follow a louder input",
+          0.0, 10000.0, DEFAULT_ATTACK_TIME,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_RELEASE_TIME,
+      g_param_spec_float ("release-time", "Release Time",
+          "Time constant in ms for the gain to follow a quieter input",
+          0.0, 60000.0, DEFAULT_RELEASE_TIME,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_RAMP_TIME,
+      g_param_spec_float ("ramp-time", "Ramp Time",
+          "Time in ms over which changes of target-loudness, target-lra "
+          "and measured-loudness reach the gain while playing",
+          0.0, 60000.0, DEFAULT_RAMP_TIME,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_LIMITER,
+      g_param_spec_boolean ("limiter", "Limiter",
+          "Keep the peaks below ceiling with a lookahead limiter instead of "
+          "clipping them, which delays the output by lookahead (applied on "
+          "the next caps)",
+          FALSE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_LOOKAHEAD,
+      g_param_spec_float ("lookahead", "Lookahead",
+          "Time in ms the limiter sees peaks coming, and the latency it adds "
+          "(applied on the next caps)",
+          1.0, 10.0, DEFAULT_LOOKAHEAD,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CEILING,
+      g_param_spec_float ("ceiling", "Ceiling",
+          "Highest sample level in dBFS the limiter lets through (applied on "
+          "the next caps)",
+          -20.0, 0.0, DEFAULT_CEILING,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TRUE_PEAK_CEILING,
+      g_param_spec_float ("true-peak-ceiling", "True Peak Ceiling",
+          "Highest true peak in dBTP the gain may push the output to, "
+          "0 to leave true peaks alone (applied on the next caps)",
+          -20.0, 0.0, DEFAULT_TRUE_PEAK_CEILING,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATE_LOCATION,
+      g_param_spec_string ("state-location", "State Location",
+          "File the realtime loudness state is saved to on EOS and stop "
+          "and restored from on the next start (NULL = disabled)",
+          NULL, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Stats Interval",
+          "Interval in ms between loudnorm-stats element messages "
+          "(0 = disabled)", 0, G_MAXUINT, 0,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_BUFFERS,
+      g_param_spec_uint64 ("stats-buffers", "Buffers",
+          "Number of buffers processed", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_SAMPLES,
+      g_param_spec_uint64 ("stats-samples", "Samples",
+          "Number of samples processed", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_EBUR128_TIME,
+      g_param_spec_uint64 ("stats-ebur128-time", "Measurement Time",
+          "Total time spent in loudness measurement in ns", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_GAIN_TIME,
+      g_param_spec_uint64 ("stats-gain-time", "Gain Time",
+          "Total time spent applying the gain in ns", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_MAX_LATENCY,
+      g_param_spec_uint64 ("stats-max-latency", "Max Latency",
+          "Longest time spent on a single buffer in ns", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_CLIPPED_SAMPLES,
+      g_param_spec_uint64 ("stats-clipped-samples", "Clipped Samples",
+          "Number of samples clipped by the gain stage", 0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_STATS_SHORTTERM_LOUDNESS,
+      g_param_spec_double ("stats-shortterm-loudness", "Short-term Loudness",
+          "Current short-term loudness in LUFS", -HUGE_VAL, G_MAXDOUBLE,
+          -HUGE_VAL,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_STATS_MOMENTARY_LOUDNESS,
+      g_param_spec_double ("stats-momentary-loudness", "Momentary Loudness",
+          "Current momentary loudness in LUFS", -HUGE_VAL, G_MAXDOUBLE,
+          -HUGE_VAL,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_GAIN,
+      g_param_spec_double ("stats-gain", "Gain",
+          "Gain currently applied in dB", -G_MAXDOUBLE, G_MAXDOUBLE, 0.0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_BOUNDED_MEMORY,
+      g_param_spec_boolean ("bounded-memory", "Bounded Memory",
+          "Gate integrated loudness and LRA with fixed-size histograms "
+          "instead of keeping every block (applied on the next caps)", FALSE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_HISTORY,
+      g_param_spec_uint ("max-history", "Max History",
+          "History in ms kept for integrated loudness and LRA without "
+          "bounded-memory, at least 3000 (0 = unlimited, applied on the "
+          "next caps)", 0, G_MAXUINT, 0,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_WINDOW,
+      g_param_spec_uint ("max-window", "Max Window",
+          "Length in ms of the sample window ebur128 keeps, at least 3000 "
+          "(0 = default, applied on the next caps)", 0, G_MAXUINT, 0,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MEMORY_FOOTPRINT,
+      g_param_spec_uint64 ("memory-footprint", "Memory Footprint",
+          "Estimated memory held by the loudness measurement in bytes",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MEASURE_RATE,
+      g_param_spec_uint ("measure-rate", "Measure Rate",
+          "Rate in Hz the realtime gain measures at, at least 8000 "
+          "(0 = stream rate, applied on the next caps)", 0, G_MAXUINT, 0,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MEASURE_THREADS,
+      g_param_spec_uint ("measure-threads", "Measure Threads",
+          "Threads measuring groups of 4 channels of wide streams in "
+          "parallel (0 = 1, applied on the next caps)", 0, 64, 0,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
   gobject_class->dispose = gst_loudnorm_dispose;
   gobject_class->finalize = gst_loudnorm_finalize;
   audio_filter_class->setup = GST_DEBUG_FUNCPTR (gst_loudnorm_setup);
-  //base_transform_class->transform = GST_DEBUG_FUNCPTR (gst_loudnorm_transform);
+  base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_loudnorm_stop);
+  base_transform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_sink_event);
+  base_transform_class->query = GST_DEBUG_FUNCPTR (gst_loudnorm_query);
+  base_transform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_decide_allocation);
+  base_transform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_propose_allocation);
+  base_transform_class->prepare_output_buffer =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_prepare_output_buffer);
+  base_transform_class->transform = GST_DEBUG_FUNCPTR (gst_loudnorm_transform);
   base_transform_class->transform_ip =
       GST_DEBUG_FUNCPTR (gst_loudnorm_transform_ip);
+  /* measurement has to continue while we are in passthrough */
+  base_transform_class->transform_ip_on_passthrough = TRUE;
 
+  loudnorm_gain_init ();
+  GST_DEBUG ("using %s gain kernel", loudnorm_gain_get_impl_name ());
 }
 
 static void
 gst_loudnorm_init (GstLoudnorm * this)
 {
-  this->ebur128_state = ebur128_init (1, 48000, EBUR128_MODE_I|EBUR128_MODE_LRA);
+  /* the measurement is set up once the caps are known */
   this->target_loudness = -23.0;
-  this->target_lra = 5.0;
-  initQueue(&this->gain_history);
-  precomputeGaussianKernel(this->kernel);
+  this->target_lra = DEFAULT_TARGET_LRA;
+  this->mode = GST_LOUDNORM_MODE_REALTIME;
+  this->measured_loudness = -23.0;
+  this->integrated_loudness = -HUGE_VAL;
+  this->attack_time = DEFAULT_ATTACK_TIME;
+  this->release_time = DEFAULT_RELEASE_TIME;
+  this->silence_threshold = DEFAULT_SILENCE_THRESHOLD;
+  this->ramp_time = DEFAULT_RAMP_TIME;
+  this->lookahead = DEFAULT_LOOKAHEAD;
+  this->ceiling = DEFAULT_CEILING;
+  this->true_peak_ceiling = DEFAULT_TRUE_PEAK_CEILING;
+  this->limiter_end = GST_CLOCK_TIME_NONE;
+  this->applied_gain = NAN;
+  this->stats.shortterm_loudness = -HUGE_VAL;
+  this->stats.momentary_loudness = -HUGE_VAL;
+  g_mutex_init (&this->analysis_lock);
+  g_cond_init (&this->analysis_cond);
+  g_mutex_init (&this->measure_lock);
+  g_cond_init (&this->measure_cond);
+}
+
+/* Returns the processor to the pool for the next element with the same
+ * caps. Any threads using it have to be stopped. */
+static void
+gst_loudnorm_release_processor (GstLoudnorm * this)
+{
+  loudnorm_pool_release (&this->processor_key, this->processor);
+  this->processor = NULL;
+  this->meter = NULL;
+}
+
+/* Hands the gain settings to a new processor, which starts out at the
+ * targets right away */
+static void
+gst_loudnorm_configure_processor (GstLoudnorm * this)
+{
+  this->params_seen = g_atomic_int_get (&this->params_serial);
+
+  loudnorm_processor_set_target (this->processor,
+      params_get_float (&this->target_loudness),
+      params_get_float (&this->target_lra));
+  loudnorm_processor_set_silence_threshold (this->processor,
+      params_get_float (&this->silence_threshold));
+  loudnorm_processor_set_times (this->processor,
+      params_get_float (&this->attack_time),
+      params_get_float (&this->release_time));
+
+  loudnorm_ramp_init (&this->static_gain, NAN);
+  this->applied_gain = NAN;
+}
+
+/* Picks up settings changed since the last buffer, on the thread that
+ * measures. The targets ramp, the rest takes effect right away. */
+static void
+gst_loudnorm_update_processor (GstLoudnorm * this)
+{
+  gint serial = g_atomic_int_get (&this->params_serial);
+
+  if (serial == this->params_seen)
+    return;
+  this->params_seen = serial;
+
+  loudnorm_processor_ramp_target (this->processor,
+      params_get_float (&this->target_loudness),
+      params_get_float (&this->target_lra),
+      params_get_float (&this->ramp_time));
+  loudnorm_processor_set_silence_threshold (this->processor,
+      params_get_float (&this->silence_threshold));
+  loudnorm_processor_set_times (this->processor,
+      params_get_float (&this->attack_time),
+      params_get_float (&this->release_time));
 }
 
 void
@@ -241,13 +756,85 @@ gst_loudnorm_set_property (GObject * object, guint property_id,
 
   switch (property_id) {
     case PROP_TARGET_LOUDNESS:
-      this->target_loudness = g_value_get_float (value);
+      params_publish (&this->params_serial, &this->target_loudness,
+          g_value_get_float (value));
       break;
     case PROP_TARGET_LRA:
-      this->target_lra = g_value_get_float (value);
+      params_publish (&this->params_serial, &this->target_lra,
+          g_value_get_float (value));
       break;
     case PROP_SILENT_THRESHOLD:
-      this->silence_threshold = g_value_get_float (value);
+      params_publish (&this->params_serial, &this->silence_threshold,
+          g_value_get_float (value));
+      break;
+    case PROP_ASYNC_MEASURE:
+      this->async_measure = g_value_get_boolean (value);
+      break;
+    case PROP_UNITY_TOLERANCE:
+      this->unity_tolerance = g_value_get_float (value);
+      break;
+    case PROP_MODE:
+      this->mode = g_value_get_enum (value);
+      break;
+    case PROP_MEASURED_LOUDNESS:
+      params_publish (&this->params_serial, &this->measured_loudness,
+          g_value_get_float (value));
+      break;
+    case PROP_CACHE_DIR:
+      g_free (this->cache_dir);
+      this->cache_dir = g_value_dup_string (value);
+      break;
+    case PROP_CACHE_KEY:
+      g_free (this->cache_key);
+      this->cache_key = g_value_dup_string (value);
+      break;
+    case PROP_CACHE_TIMELINE:
+      this->cache_timeline = g_value_get_boolean (value);
+      break;
+    case PROP_ATTACK_TIME:
+      params_publish (&this->params_serial, &this->attack_time,
+          g_value_get_float (value));
+      break;
+    case PROP_RELEASE_TIME:
+      params_publish (&this->params_serial, &this->release_time,
+          g_value_get_float (value));
+      break;
+    case PROP_STATS_INTERVAL:
+      this->stats_interval = g_value_get_uint (value);
+      break;
+    case PROP_BOUNDED_MEMORY:
+      this->bounded_memory = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_HISTORY:
+      this->max_history = g_value_get_uint (value);
+      break;
+    case PROP_MAX_WINDOW:
+      this->max_window = g_value_get_uint (value);
+      break;
+    case PROP_MEASURE_RATE:
+      this->measure_rate = g_value_get_uint (value);
+      break;
+    case PROP_MEASURE_THREADS:
+      this->measure_threads = g_value_get_uint (value);
+      break;
+    case PROP_RAMP_TIME:
+      params_set_float (&this->ramp_time, g_value_get_float (value));
+      break;
+    case PROP_LIMITER:
+      this->limiter = g_value_get_boolean (value);
+      break;
+    case PROP_LOOKAHEAD:
+      this->lookahead = g_value_get_float (value);
+      break;
+    case PROP_CEILING:
+      this->ceiling = g_value_get_float (value);
+      break;
+    case PROP_TRUE_PEAK_CEILING:
+      this->true_peak_ceiling = g_value_get_float (value);
+      break;
+    case PROP_STATE_LOCATION:
+      g_free (this->state_location);
+      this->state_location = g_value_dup_string (value);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -273,6 +860,107 @@ gst_loudnorm_get_property (GObject * object, guint property_id,
     case PROP_SILENT_THRESHOLD:
       g_value_set_float (value, this->silence_threshold);
       break;
+    case PROP_ASYNC_MEASURE:
+      g_value_set_boolean (value, this->async_measure);
+      break;
+    case PROP_UNITY_TOLERANCE:
+      g_value_set_float (value, this->unity_tolerance);
+      break;
+    case PROP_MODE:
+      g_value_set_enum (value, this->mode);
+      break;
+    case PROP_MEASURED_LOUDNESS:
+      g_value_set_float (value, this->measured_loudness);
+      break;
+    case PROP_INTEGRATED_LOUDNESS:
+      g_value_set_double (value, this->integrated_loudness);
+      break;
+    case PROP_LOUDNESS_RANGE:
+      g_value_set_double (value, this->loudness_range);
+      break;
+    case PROP_CACHE_DIR:
+      g_value_set_string (value, this->cache_dir);
+      break;
+    case PROP_CACHE_KEY:
+      g_value_set_string (value, this->cache_key);
+      break;
+    case PROP_CACHE_TIMELINE:
+      g_value_set_boolean (value, this->cache_timeline);
+      break;
+    case PROP_ATTACK_TIME:
+      g_value_set_float (value, this->attack_time);
+      break;
+    case PROP_RELEASE_TIME:
+      g_value_set_float (value, this->release_time);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, this->stats_interval);
+      break;
+    case PROP_STATS_BUFFERS:
+      g_value_set_uint64 (value, STATS_GET (this, buffers));
+      break;
+    case PROP_STATS_SAMPLES:
+      g_value_set_uint64 (value, STATS_GET (this, samples));
+      break;
+    case PROP_STATS_EBUR128_TIME:
+      g_value_set_uint64 (value, STATS_GET (this, ebur128_time));
+      break;
+    case PROP_STATS_GAIN_TIME:
+      g_value_set_uint64 (value, STATS_GET (this, gain_time));
+      break;
+    case PROP_STATS_MAX_LATENCY:
+      g_value_set_uint64 (value, STATS_GET (this, max_latency));
+      break;
+    case PROP_STATS_CLIPPED_SAMPLES:
+      g_value_set_uint64 (value, STATS_GET (this, clipped_samples));
+      break;
+    case PROP_STATS_SHORTTERM_LOUDNESS:
+      g_value_set_double (value,
+          stats_get_double (&this->stats.shortterm_loudness));
+      break;
+    case PROP_STATS_MOMENTARY_LOUDNESS:
+      g_value_set_double (value,
+          stats_get_double (&this->stats.momentary_loudness));
+      break;
+    case PROP_STATS_GAIN:
+      g_value_set_double (value, stats_get_double (&this->stats.gain));
+      break;
+    case PROP_BOUNDED_MEMORY:
+      g_value_set_boolean (value, this->bounded_memory);
+      break;
+    case PROP_MAX_HISTORY:
+      g_value_set_uint (value, this->max_history);
+      break;
+    case PROP_MAX_WINDOW:
+      g_value_set_uint (value, this->max_window);
+      break;
+    case PROP_MEMORY_FOOTPRINT:
+      g_value_set_uint64 (value, gst_loudnorm_get_memory_footprint (this));
+      break;
+    case PROP_MEASURE_RATE:
+      g_value_set_uint (value, this->measure_rate);
+      break;
+    case PROP_MEASURE_THREADS:
+      g_value_set_uint (value, this->measure_threads);
+      break;
+    case PROP_RAMP_TIME:
+      g_value_set_float (value, this->ramp_time);
+      break;
+    case PROP_LIMITER:
+      g_value_set_boolean (value, this->limiter);
+      break;
+    case PROP_LOOKAHEAD:
+      g_value_set_float (value, this->lookahead);
+      break;
+    case PROP_CEILING:
+      g_value_set_float (value, this->ceiling);
+      break;
+    case PROP_TRUE_PEAK_CEILING:
+      g_value_set_float (value, this->true_peak_ceiling);
+      break;
+    case PROP_STATE_LOCATION:
+      g_value_set_string (value, this->state_location);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -286,9 +974,15 @@ gst_loudnorm_dispose (GObject * object)
 
   GST_DEBUG_OBJECT (this, "dispose");
 
+  gst_loudnorm_stop_analysis (this);
+  gst_loudnorm_stop_measure_pool (this);
+
+#ifndef LOUDNORM_INTERNAL_METER
   if (this->ebur128_state) {
     ebur128_destroy (&this->ebur128_state);
   }
+#endif
+  gst_loudnorm_release_processor (this);
 
   G_OBJECT_CLASS (gst_loudnorm_parent_class)->dispose (object);
 }
@@ -300,77 +994,1352 @@ gst_loudnorm_finalize (GObject * object)
 
   GST_DEBUG_OBJECT (this, "finalize");
 
+#ifndef LOUDNORM_INTERNAL_METER
   if (this->ebur128_state) {
     ebur128_destroy (&this->ebur128_state);
   }
+#endif
+
+  g_mutex_clear (&this->analysis_lock);
+  g_cond_clear (&this->analysis_cond);
+  g_mutex_clear (&this->measure_lock);
+  g_cond_clear (&this->measure_cond);
+
+  g_free (this->cache_dir);
+  g_free (this->cache_key);
+  g_free (this->state_location);
+  g_free (this->stream_id);
+  loudnorm_cache_entry_free (this->cache_entry);
+  if (this->timeline)
+    g_array_free (this->timeline, TRUE);
 
   G_OBJECT_CLASS (gst_loudnorm_parent_class)->finalize (object);
 }
 
+/* Maps GStreamer channel positions on the BS.1770 channel weights */
+static LoudnormFormat
+gst_loudnorm_processor_format (GstAudioFormat format)
+{
+  switch (format) {
+    case GST_AUDIO_FORMAT_S16LE:
+      return LOUDNORM_FORMAT_S16;
+    case GST_AUDIO_FORMAT_S32LE:
+      return LOUDNORM_FORMAT_S32;
+    case GST_AUDIO_FORMAT_F32LE:
+      return LOUDNORM_FORMAT_F32;
+    default:
+      g_assert_not_reached ();
+      return LOUDNORM_FORMAT_S16;
+  }
+}
+
+static void
+gst_loudnorm_set_channel_map (GstLoudnorm * this, const GstAudioInfo * info)
+{
+  gint channels = GST_AUDIO_INFO_CHANNELS (info);
+
+  for (gint i = 0; i < channels; i++) {
+    double weight = 1.0;
+
+    if (channels > 1 && !GST_AUDIO_INFO_IS_UNPOSITIONED (info)) {
+      switch (info->position[i]) {
+        case GST_AUDIO_CHANNEL_POSITION_LFE1:
+        case GST_AUDIO_CHANNEL_POSITION_LFE2:
+          weight = 0.0;
+          break;
+        case GST_AUDIO_CHANNEL_POSITION_REAR_LEFT:
+        case GST_AUDIO_CHANNEL_POSITION_REAR_RIGHT:
+        case GST_AUDIO_CHANNEL_POSITION_SIDE_LEFT:
+        case GST_AUDIO_CHANNEL_POSITION_SIDE_RIGHT:
+          weight = 1.41;
+          break;
+        default:
+          break;
+      }
+    }
+#ifndef LOUDNORM_INTERNAL_METER
+    if (this->ebur128_state)
+      ebur128_set_channel (this->ebur128_state, i, weight == 0.0 ?
+          EBUR128_UNUSED : weight > 1.0 ? EBUR128_LEFT_SURROUND : EBUR128_LEFT);
+#endif
+    loudnorm_meter_set_channel_weight (this->meter, i, weight);
+  }
+}
+
+#ifndef LOUDNORM_INTERNAL_METER
+/* The analyze pass needs integrated loudness, LRA and the sample peak,
+ * which are measured by ebur128 */
+static gboolean
+gst_loudnorm_setup_ebur128 (GstLoudnorm * this, guint channels, gulong rate)
+{
+  int mode = EBUR128_MODE_I|EBUR128_MODE_LRA|EBUR128_MODE_SAMPLE_PEAK;
+  int res;
+
+  if (this->bounded_memory)
+    mode |= EBUR128_MODE_HISTOGRAM;
+
+  if (this->ebur128_state && this->ebur128_mode != mode) {
+    ebur128_destroy (&this->ebur128_state);
+  }
+
+  if (this->ebur128_state == NULL) {
+    this->ebur128_mode = mode;
+    this->ebur128_state = ebur128_init (channels, rate, mode);
+    res = this->ebur128_state ? EBUR128_SUCCESS : EBUR128_ERROR_NOMEM;
+  } else {
+    res = ebur128_change_parameters (this->ebur128_state, channels, rate);
+  }
+
+  if (res != EBUR128_SUCCESS && res != EBUR128_ERROR_NO_CHANGE) {
+    GST_ERROR_OBJECT (this, "Failed to configure ebur128 for %u channels "
+        "at %lu Hz: %d", channels, rate, res);
+    return FALSE;
+  }
+
+  res = ebur128_set_max_window (this->ebur128_state,
+      this->max_window ? MAX (this->max_window, MIN_WINDOW_MS) :
+      DEFAULT_WINDOW_MS);
+  if (res == EBUR128_ERROR_NOMEM) {
+    GST_ERROR_OBJECT (this, "Failed to allocate the ebur128 window");
+    ebur128_destroy (&this->ebur128_state);
+    return FALSE;
+  }
+
+  ebur128_set_max_history (this->ebur128_state,
+      this->max_history ? MAX (this->max_history, MIN_HISTORY_MS) :
+      ULONG_MAX);
+
+  return TRUE;
+}
+#endif
+
+/* The limiter delays the output, tell the pipeline when that changes */
+static void
+gst_loudnorm_set_latency (GstLoudnorm * this, guint frames)
+{
+  /* a new limiter starts with a delay line of silence */
+  this->limiter_end = GST_CLOCK_TIME_NONE;
+  this->limiter_skip = frames;
+
+  if ((guint) g_atomic_int_get (&this->latency) == frames)
+    return;
+
+  GST_DEBUG_OBJECT (this, "latency %u frames", frames);
+  g_atomic_int_set (&this->latency, frames);
+  gst_element_post_message (GST_ELEMENT (this),
+      gst_message_new_latency (GST_OBJECT (this)));
+}
+
+/* Writes the realtime measurement and gain to state-location. A stream
+ * that ended in silence has nothing left in its windows, the previous
+ * state is kept then. */
+static void
+gst_loudnorm_save_state (GstLoudnorm * this)
+{
+  GError *error = NULL;
+  gpointer state;
+  gsize size;
+
+  if (this->state_location == NULL || this->processor == NULL ||
+      this->mode != GST_LOUDNORM_MODE_REALTIME ||
+      loudnorm_meter_shortterm (this->meter) == -HUGE_VAL)
+    return;
+
+  size = loudnorm_processor_get_state_size (this->processor);
+  state = g_malloc (size);
+  size = loudnorm_processor_save_state (this->processor, state, size);
+
+  if (g_file_set_contents (this->state_location, state, size, &error)) {
+    GST_DEBUG_OBJECT (this, "saved %" G_GSIZE_FORMAT " bytes of state to %s",
+        size, this->state_location);
+  } else {
+    GST_WARNING_OBJECT (this, "Failed to save the loudness state: %s",
+        error->message);
+    g_error_free (error);
+  }
+  g_free (state);
+}
+
+/* Warm start: the new processor picks up where the saved one was */
+static void
+gst_loudnorm_load_state (GstLoudnorm * this)
+{
+  GError *error = NULL;
+  gchar *state;
+  gsize size;
+
+  if (this->state_location == NULL ||
+      this->mode != GST_LOUDNORM_MODE_REALTIME)
+    return;
+
+  if (!g_file_get_contents (this->state_location, &state, &size, &error)) {
+    /* nothing saved yet on the first run */
+    if (g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      GST_DEBUG_OBJECT (this, "no state in %s yet", this->state_location);
+    else
+      GST_WARNING_OBJECT (this, "Failed to load the loudness state: %s",
+          error->message);
+    g_error_free (error);
+    return;
+  }
+
+  if (loudnorm_processor_restore_state (this->processor, state, size))
+    GST_INFO_OBJECT (this, "restored the loudness state from %s",
+        this->state_location);
+  else
+    GST_WARNING_OBJECT (this, "%s holds no loudness state, starting cold",
+        this->state_location);
+  g_free (state);
+}
+
 static gboolean
 gst_loudnorm_setup (GstAudioFilter * filter, const GstAudioInfo * info)
 {
   GstLoudnorm *this = GST_LOUDNORM (filter);
+  guint channels = GST_AUDIO_INFO_CHANNELS (info);
+  gulong rate = GST_AUDIO_INFO_RATE (info);
+  guint factor = 1;
+
+  GST_DEBUG_OBJECT (this, "setup %s, %u channels, %lu Hz",
+      gst_audio_format_to_string (GST_AUDIO_INFO_FORMAT (info)), channels,
+      rate);
+
+  /* the analysis thread owns the meter while it runs */
+  gst_loudnorm_stop_analysis (this);
+
+#ifndef LOUDNORM_INTERNAL_METER
+  if (this->mode == GST_LOUDNORM_MODE_ANALYZE) {
+    if (!gst_loudnorm_setup_ebur128 (this, channels, rate))
+      return FALSE;
+  } else if (this->ebur128_state) {
+    ebur128_destroy (&this->ebur128_state);
+  }
+#endif
+
+  /* short-term and momentary loudness for the realtime gain, which does
+   * not need every sample on slow CPUs */
+  if (this->mode == GST_LOUDNORM_MODE_REALTIME && this->measure_rate > 0)
+    factor = MAX (rate / MAX (this->measure_rate, MIN_MEASURE_RATE), 1);
+
+  /* new caps carry the state over through the file as well */
+  gst_loudnorm_save_state (this);
+  gst_loudnorm_release_processor (this);
+
+  this->processor_key.format =
+      gst_loudnorm_processor_format (GST_AUDIO_INFO_FORMAT (info));
+  this->processor_key.rate = rate;
+  this->processor_key.channels = channels;
+  this->processor_key.factor = factor;
+#ifdef LOUDNORM_INTERNAL_METER
+  /* without ebur128 the meter measures the analyze pass as well */
+  this->processor_key.gating = this->mode == GST_LOUDNORM_MODE_ANALYZE;
+#else
+  this->processor_key.gating = FALSE;
+#endif
+  this->processor = loudnorm_pool_acquire (&this->processor_key);
+  if (this->processor == NULL) {
+    GST_ERROR_OBJECT (this, "Failed to allocate the loudness meter");
+    return FALSE;
+  }
+  this->meter = loudnorm_processor_get_meter (this->processor);
+  gst_loudnorm_configure_processor (this);
+
+  /* the analyze pass never changes the samples, nothing to limit */
+  if (this->limiter && this->mode != GST_LOUDNORM_MODE_ANALYZE &&
+      !loudnorm_processor_set_limiter (this->processor, this->lookahead,
+          this->ceiling)) {
+    GST_ERROR_OBJECT (this, "Failed to allocate the limiter");
+    return FALSE;
+  }
+  if (this->mode != GST_LOUDNORM_MODE_ANALYZE &&
+      !loudnorm_processor_set_true_peak_ceiling (this->processor,
+          this->true_peak_ceiling)) {
+    GST_ERROR_OBJECT (this, "Failed to allocate the true-peak meter");
+    return FALSE;
+  }
+  /* the analysis thread measures frames the streaming thread has long
+   * sent on, the cap has to see the ones the gain scales */
+  loudnorm_processor_defer_true_peak (this->processor,
+      this->mode == GST_LOUDNORM_MODE_REALTIME && this->async_measure);
+  gst_loudnorm_set_latency (this,
+      loudnorm_processor_get_latency (this->processor));
+  gst_loudnorm_load_state (this);
+
+  GST_DEBUG_OBJECT (this, "using %s meter kernel at %lu Hz",
+      loudnorm_meter_get_impl_name (this->meter), rate / factor);
+
+  if (!gst_loudnorm_shard_meter (this))
+    return FALSE;
 
-  GST_DEBUG_OBJECT (this, "setup");
+  gst_loudnorm_set_channel_map (this, info);
+
+  /* the analyze pass never touches the samples */
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (this),
+      this->mode == GST_LOUDNORM_MODE_ANALYZE);
+
+  if (this->mode == GST_LOUDNORM_MODE_REALTIME && this->async_measure &&
+      !gst_loudnorm_start_analysis (this))
+    return FALSE;
 
   return TRUE;
 }
 
-static GstFlowReturn
-gst_loudnorm_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+static gboolean
+gst_loudnorm_stop (GstBaseTransform * trans)
 {
   GstLoudnorm *this = GST_LOUDNORM (trans);
 
-  GST_DEBUG_OBJECT (this, "transform_ip");
+  GST_DEBUG_OBJECT (this, "stop");
 
-  GstMapInfo map;
-  if (!gst_buffer_map (buf, &map, GST_MAP_READWRITE)) {
-    GST_ERROR_OBJECT (this, "Failed to map buffer");
-    return GST_FLOW_ERROR;
+  gst_loudnorm_stop_analysis (this);
+  gst_loudnorm_stop_measure_pool (this);
+  gst_loudnorm_save_state (this);
+
+  /* start the next run with a fresh measurement, setup recreates it */
+#ifndef LOUDNORM_INTERNAL_METER
+  if (this->ebur128_state) {
+    ebur128_destroy (&this->ebur128_state);
+  }
+#endif
+  gst_loudnorm_release_processor (this);
+  gst_loudnorm_set_latency (this, 0);
+
+  g_clear_pointer (&this->stream_id, g_free);
+  g_clear_pointer (&this->cache_entry, loudnorm_cache_entry_free);
+  if (this->timeline) {
+    g_array_free (this->timeline, TRUE);
+    this->timeline = NULL;
   }
+  this->timeline_frames = 0;
+  this->measured_frames = 0;
+
+  gst_clear_object (&this->pool);
+  this->pool_size = 0;
 
-  guint samples = gst_buffer_get_size (buf) / sizeof (int16_t);
+  return TRUE;
+}
 
-  int16_t *samples_ptr = (int16_t *) map.data;
+/* Estimates what the measurement holds. The meter has a fixed size.
+ * libebur128 keeps a sample window of max-window ms, and either two fixed
+ * histograms or one list entry per 400 ms gating block (10 per second)
+ * and per short-term block (1 per second), bounded by max-history. */
+static guint64
+gst_loudnorm_get_memory_footprint (GstLoudnorm * this)
+{
+  guint64 footprint = 0;
 
-  ebur128_add_frames_short (this->ebur128_state, samples_ptr, samples);
+  if (this->processor)
+    footprint += loudnorm_processor_get_footprint (this->processor);
 
-  double loudness_shortterm;
-  ebur128_loudness_shortterm (this->ebur128_state, &loudness_shortterm);
+#ifndef LOUDNORM_INTERNAL_METER
+  const guint64 block_entry = 2 * sizeof (double) + 2 * sizeof (gpointer);
+  const guint64 histogram = 2 * 1000 * sizeof (unsigned long);
+  guint64 rate = GST_AUDIO_FILTER_RATE (this);
+  guint64 channels = GST_AUDIO_FILTER_CHANNELS (this);
+  guint64 window, seconds;
 
-  double loudness_momentary;
-  ebur128_loudness_momentary (this->ebur128_state, &loudness_momentary);
+  if (this->ebur128_state == NULL || rate == 0)
+    return footprint;
 
-  if (loudness_shortterm == -HUGE_VAL) loudness_shortterm = -23.0;
+  window = this->max_window ? MAX (this->max_window, MIN_WINDOW_MS) :
+      DEFAULT_WINDOW_MS;
+  footprint += sizeof (ebur128_state) + window * rate / 1000 * channels *
+      sizeof (double);
 
-  double shortterm_gain = this->target_loudness - loudness_shortterm;
+  if (this->ebur128_mode & EBUR128_MODE_HISTOGRAM)
+    return footprint + histogram;
 
-  double momentary_gain = this->target_loudness - loudness_momentary;
+  seconds = __atomic_load_n (&this->measured_frames, __ATOMIC_RELAXED) / rate;
+  if (this->max_history)
+    seconds = MIN (seconds, MAX (this->max_history, MIN_HISTORY_MS) / 1000);
 
-  double gain = momentary_gain < shortterm_gain ? momentary_gain : shortterm_gain;  
+  footprint += seconds * 11 * block_entry;
+#endif
 
-  pushWithGaussianFilter(&this->gain_history, gain, this->kernel);
+  return footprint;
+}
 
-  gain = topQueue(&this->gain_history);
-  
-  for (int i = 0; i < samples; ++i) {
-    if (samples_ptr[i] * pow(10, gain / 20.0) > 32767) samples_ptr[i] = 32767;
-    else if (samples_ptr[i] * pow(10, gain / 20.0) < -32768) samples_ptr[i] = -32768;
-    else samples_ptr[i] = (short)(samples_ptr[i] * pow(10, gain / 20.0));
+static const gchar *
+gst_loudnorm_get_cache_key (GstLoudnorm * this)
+{
+  return this->cache_key ? this->cache_key : this->stream_id;
+}
+
+/* Collects the integrated measurements of the analyze pass */
+static void
+gst_loudnorm_measure_summary (GstLoudnorm * this,
+    LoudnormCacheEntry * summary)
+{
+  memset (summary, 0, sizeof (LoudnormCacheEntry));
+  summary->integrated = -HUGE_VAL;
+  summary->rate = GST_AUDIO_FILTER_RATE (this);
+  summary->channels = GST_AUDIO_FILTER_CHANNELS (this);
+
+#ifdef LOUDNORM_INTERNAL_METER
+  if (this->meter == NULL)
+    return;
+
+  summary->integrated = loudnorm_meter_integrated (this->meter);
+  summary->range = loudnorm_meter_range (this->meter);
+
+  for (guint i = 0; i < summary->channels; i++)
+    summary->peak = MAX (summary->peak,
+        loudnorm_meter_sample_peak (this->meter, i));
+#else
+  if (this->ebur128_state == NULL)
+    return;
+
+  ebur128_loudness_global (this->ebur128_state, &summary->integrated);
+  ebur128_loudness_range (this->ebur128_state, &summary->range);
+
+  for (guint i = 0; i < summary->channels; i++) {
+    double peak;
+
+    if (ebur128_sample_peak (this->ebur128_state, i, &peak) ==
+        EBUR128_SUCCESS && peak > summary->peak)
+      summary->peak = peak;
+  }
+#endif
+
+  if (this->timeline) {
+    summary->timeline = (const float *) this->timeline->data;
+    summary->timeline_len = this->timeline->len;
   }
+}
+
+/* Posts the integrated measurements of the analyze pass */
+static void
+gst_loudnorm_post_summary (GstLoudnorm * this,
+    const LoudnormCacheEntry * summary, gboolean cached)
+{
+  GST_INFO_OBJECT (this, "integrated loudness %.2f LUFS, range %.2f LU, "
+      "peak %.4f%s", summary->integrated, summary->range, summary->peak,
+      cached ? " (cached)" : "");
+
+  GST_OBJECT_LOCK (this);
+  this->integrated_loudness = summary->integrated;
+  this->loudness_range = summary->range;
+  GST_OBJECT_UNLOCK (this);
+
+  g_object_notify (G_OBJECT (this), "integrated-loudness");
+  g_object_notify (G_OBJECT (this), "loudness-range");
+
+  gst_element_post_message (GST_ELEMENT (this),
+      gst_message_new_element (GST_OBJECT (this),
+          gst_structure_new ("loudnorm",
+              "integrated-loudness", G_TYPE_DOUBLE, summary->integrated,
+              "loudness-range", G_TYPE_DOUBLE, summary->range,
+              "sample-peak", G_TYPE_DOUBLE, summary->peak,
+              "cached", G_TYPE_BOOLEAN, cached, NULL)));
+}
+
+/* Looks the new stream up in the analysis cache */
+static void
+gst_loudnorm_lookup_cache (GstLoudnorm * this)
+{
+  const gchar *key = gst_loudnorm_get_cache_key (this);
+
+  g_clear_pointer (&this->cache_entry, loudnorm_cache_entry_free);
+
+  if (this->cache_dir == NULL || key == NULL)
+    return;
+
+  this->cache_entry = loudnorm_cache_lookup (this->cache_dir, key);
+  if (this->cache_entry == NULL) {
+    GST_DEBUG_OBJECT (this, "cache miss for %s", key);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (this, "cache hit for %s", key);
+
+  if (this->mode == GST_LOUDNORM_MODE_ANALYZE)
+    gst_loudnorm_post_summary (this, this->cache_entry, TRUE);
+}
+
+/* End of the analyze pass: report and remember the results */
+static void
+gst_loudnorm_finish_analysis (GstLoudnorm * this)
+{
+  LoudnormCacheEntry summary;
+  const gchar *key = gst_loudnorm_get_cache_key (this);
+  GError *error = NULL;
+
+  // a cache hit was already reported at stream start
+  if (this->cache_entry)
+    return;
+
+  gst_loudnorm_measure_summary (this, &summary);
+  gst_loudnorm_post_summary (this, &summary, FALSE);
+
+  if (this->cache_dir == NULL || key == NULL)
+    return;
+
+  if (!loudnorm_cache_store (this->cache_dir, key, &summary, &error)) {
+    GST_WARNING_OBJECT (this, "Failed to store analysis in cache: %s",
+        error->message);
+    g_error_free (error);
+  }
+}
 
-  //unmap the buffer
+/* Pushes the input the limiter still holds at EOS, right after the last
+ * buffer, without the silence it started with */
+static void
+gst_loudnorm_drain (GstLoudnorm * this)
+{
+  guint latency = g_atomic_int_get (&this->latency);
+  guint bpf = GST_AUDIO_FILTER_BPF (this);
+  guint frames = latency - this->limiter_skip;
+
+  if (frames == 0 || this->processor == NULL ||
+      !GST_CLOCK_TIME_IS_VALID (this->limiter_end))
+    return;
+
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, (gsize) latency * bpf,
+      NULL);
+  GstLoudnormMeta *meta = gst_buffer_add_loudnorm_meta (buf);
+  double gain = isnan (this->applied_gain) ? 0.0 : this->applied_gain;
+  GstMapInfo map;
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_WRITE)) {
+    gst_buffer_unref (buf);
+    return;
+  }
+  loudnorm_processor_drain (this->processor, map.data);
+
+  /* the frames got their gain and were measured on the way in, with the
+   * last buffers */
+  gboolean measured = this->mode == GST_LOUDNORM_MODE_REALTIME &&
+      !(this->cache_entry && isfinite (this->cache_entry->integrated));
+
+  meta->shortterm_loudness = measured ?
+      stats_get_double (&this->stats.shortterm_loudness) : NAN;
+  meta->momentary_loudness = measured ?
+      stats_get_double (&this->stats.momentary_loudness) : NAN;
+  meta->gain = gain;
+  meta->peak = loudnorm_processor_peak (this->processor,
+      map.data + (gsize) this->limiter_skip * bpf, frames) /
+      pow (10, gain / 20.0);
+  meta->clipped = FALSE;
   gst_buffer_unmap (buf, &map);
-  
+  gst_buffer_resize (buf, (gssize) this->limiter_skip * bpf,
+      (gssize) frames * bpf);
+
+  GstClockTime duration = gst_util_uint64_scale_int (frames, GST_SECOND,
+      GST_AUDIO_FILTER_RATE (this));
+
+  GST_BUFFER_PTS (buf) = this->limiter_end > duration ?
+      this->limiter_end - duration : 0;
+  GST_BUFFER_DURATION (buf) = duration;
+  this->limiter_end = GST_CLOCK_TIME_NONE;
+  this->limiter_skip = latency;
+
+  GST_DEBUG_OBJECT (this, "draining %u frames of the limiter", frames);
+
+  GstFlowReturn ret = gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (this), buf);
+  if (ret != GST_FLOW_OK)
+    GST_DEBUG_OBJECT (this, "drain push returned %s",
+        gst_flow_get_name (ret));
+}
+
+static gboolean
+gst_loudnorm_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstLoudnorm *this = GST_LOUDNORM (trans);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_STREAM_START:{
+      const gchar *stream_id;
+
+      gst_event_parse_stream_start (event, &stream_id);
+      g_free (this->stream_id);
+      this->stream_id = g_strdup (stream_id);
+      gst_loudnorm_lookup_cache (this);
+      break;
+    }
+    case GST_EVENT_EOS:
+      if (this->mode == GST_LOUDNORM_MODE_ANALYZE)
+        gst_loudnorm_finish_analysis (this);
+      gst_loudnorm_drain (this);
+      /* with async-measure the analysis thread still owns the processor,
+       * stop saves it */
+      if (this->analysis_thread == NULL)
+        gst_loudnorm_save_state (this);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      if (this->processor)
+        loudnorm_processor_flush (this->processor);
+      this->limiter_end = GST_CLOCK_TIME_NONE;
+      this->limiter_skip = g_atomic_int_get (&this->latency);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (gst_loudnorm_parent_class)->sink_event
+      (trans, event);
+}
+
+/* Adds the delay of the limiter to what upstream reports */
+static gboolean
+gst_loudnorm_query (GstBaseTransform * trans, GstPadDirection direction,
+    GstQuery * query)
+{
+  GstLoudnorm *this = GST_LOUDNORM (trans);
+  guint frames = g_atomic_int_get (&this->latency);
+
+  if (!GST_BASE_TRANSFORM_CLASS (gst_loudnorm_parent_class)->query (trans,
+          direction, query))
+    return FALSE;
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_LATENCY &&
+      direction == GST_PAD_SRC && frames > 0) {
+    GstClockTime min, max;
+    gboolean live;
+    GstClockTime latency = gst_util_uint64_scale_int (frames, GST_SECOND,
+        GST_AUDIO_FILTER_RATE (this));
+
+    gst_query_parse_latency (query, &live, &min, &max);
+    min += latency;
+    if (GST_CLOCK_TIME_IS_VALID (max))
+      max += latency;
+    gst_query_set_latency (query, live, min, max);
+
+    GST_DEBUG_OBJECT (this, "added %" GST_TIME_FORMAT " of latency",
+        GST_TIME_ARGS (latency));
+  }
+
+  return TRUE;
+}
+
+/* Feeds interleaved frames in the negotiated format to the analyze pass */
+static void
+gst_loudnorm_add_frames (GstLoudnorm * this, GstAudioFormat format,
+    gconstpointer data, gsize frames)
+{
+  __atomic_store_n (&this->measured_frames, this->measured_frames + frames,
+      __ATOMIC_RELAXED);
+
+#ifdef LOUDNORM_INTERNAL_METER
+  loudnorm_processor_add (this->processor, data, frames);
+#else
+  switch (format) {
+    case GST_AUDIO_FORMAT_S16LE:
+      ebur128_add_frames_short (this->ebur128_state, (const short *) data,
+          frames);
+      break;
+    case GST_AUDIO_FORMAT_S32LE:
+      ebur128_add_frames_int (this->ebur128_state, (const int *) data,
+          frames);
+      break;
+    case GST_AUDIO_FORMAT_F32LE:
+      ebur128_add_frames_float (this->ebur128_state, (const float *) data,
+          frames);
+      break;
+    default:
+      g_assert_not_reached ();
+      break;
+  }
+#endif
+}
+
+/* Feeds the analyze pass, sampling the momentary loudness for the cache
+ * timeline every LOUDNORM_CACHE_TIMELINE_INTERVAL_MS */
+static void
+gst_loudnorm_add_frames_timeline (GstLoudnorm * this, GstAudioFormat format,
+    const guint8 * data, gsize frames)
+{
+  guint bpf = GST_AUDIO_FILTER_BPF (this);
+  guint64 interval = (guint64) GST_AUDIO_FILTER_RATE (this) *
+      LOUDNORM_CACHE_TIMELINE_INTERVAL_MS / 1000;
+
+  if (!this->cache_timeline || this->cache_dir == NULL || interval == 0) {
+    gst_loudnorm_add_frames (this, format, data, frames);
+    return;
+  }
+
+  if (this->timeline == NULL)
+    this->timeline = g_array_new (FALSE, FALSE, sizeof (float));
+
+  while (frames > 0) {
+    guint64 left = interval - this->timeline_frames % interval;
+    gsize n = MIN (frames, left);
+
+    gst_loudnorm_add_frames (this, format, data, n);
+    this->timeline_frames += n;
+    data += n * bpf;
+    frames -= n;
+
+    if (n == left) {
+      double momentary;
+      float value;
+
+#ifdef LOUDNORM_INTERNAL_METER
+      momentary = loudnorm_meter_momentary (this->meter);
+#else
+      ebur128_loudness_momentary (this->ebur128_state, &momentary);
+#endif
+      value = momentary;
+      g_array_append_val (this->timeline, value);
+    }
+  }
+}
+
+/* Measures frames and returns the new smoothed gain in dB. Runs on the
+ * streaming thread, or on the analysis thread in async-measure mode.
+ * While the momentary loudness is below the silence threshold the gain
+ * stays frozen and silent is set; quiet frames are not even filtered. */
+static double
+gst_loudnorm_measure (GstLoudnorm * this, gconstpointer data, gsize frames,
+    gboolean * silent)
+{
+  guint64 start = stats_now ();
+  int is_silent;
+
+  gst_loudnorm_update_processor (this);
+
+  double gain = loudnorm_processor_measure (this->processor, data, frames,
+      &is_silent);
+
+  *silent = is_silent;
+  stats_set_double (&this->stats.momentary_loudness,
+      loudnorm_meter_momentary (this->meter));
+  if (!is_silent)
+    stats_set_double (&this->stats.shortterm_loudness,
+        loudnorm_meter_shortterm (this->meter));
+
+  STATS_ADD (this, ebur128_time, stats_now () - start);
+
+  return gain;
+}
+
+/* The gain of the apply pass and of cached streams. Changes of the
+ * targets ramp like in realtime mode. */
+static double
+gst_loudnorm_static_gain (GstLoudnorm * this, double measured, guint frames)
+{
+  double gain = params_get_float (&this->target_loudness) - measured;
+
+  if (isnan (this->static_gain.value))
+    loudnorm_ramp_init (&this->static_gain, gain);
+  else if (gain != this->static_gain.target)
+    loudnorm_ramp_set (&this->static_gain, gain,
+        params_get_float (&this->ramp_time));
+
+  return loudnorm_ramp_advance (&this->static_gain,
+      frames * 1000.0 / GST_AUDIO_FILTER_RATE (this));
+}
+
+/* Posts a loudnorm-stats element message at most every stats-interval */
+static void
+gst_loudnorm_post_stats (GstLoudnorm * this, guint64 now)
+{
+  guint64 interval = (guint64) this->stats_interval * GST_MSECOND;
+
+  if (interval == 0 || now - this->stats_last_post < interval)
+    return;
+
+  this->stats_last_post = now;
+
+  gst_element_post_message (GST_ELEMENT (this),
+      gst_message_new_element (GST_OBJECT (this),
+          gst_structure_new ("loudnorm-stats",
+              "buffers", G_TYPE_UINT64, STATS_GET (this, buffers),
+              "samples", G_TYPE_UINT64, STATS_GET (this, samples),
+              "ebur128-time", G_TYPE_UINT64, STATS_GET (this, ebur128_time),
+              "gain-time", G_TYPE_UINT64, STATS_GET (this, gain_time),
+              "max-latency", G_TYPE_UINT64, STATS_GET (this, max_latency),
+              "clipped-samples", G_TYPE_UINT64,
+              STATS_GET (this, clipped_samples),
+              "shortterm-loudness", G_TYPE_DOUBLE,
+              stats_get_double (&this->stats.shortterm_loudness),
+              "momentary-loudness", G_TYPE_DOUBLE,
+              stats_get_double (&this->stats.momentary_loudness),
+              "gain", G_TYPE_DOUBLE, stats_get_double (&this->stats.gain),
+              NULL)));
+}
+
+/* Primitives for the async-measure analysis thread */
+
+static void
+gst_loudnorm_publish_gain (GstLoudnorm * this, float gain, gboolean silent)
+{
+  union { float f; gint i; } u = { .f = gain };
+
+  g_atomic_int_set (&this->published_gain, u.i);
+  g_atomic_int_set (&this->published_silent, silent);
+}
+
+static float
+gst_loudnorm_get_published_gain (GstLoudnorm * this)
+{
+  union { float f; gint i; } u;
+
+  u.i = g_atomic_int_get (&this->published_gain);
+  return u.f;
+}
+
+static gpointer
+gst_loudnorm_analysis_thread (gpointer user_data)
+{
+  GstLoudnorm *this = GST_LOUDNORM (user_data);
+  guint bpf = GST_AUDIO_FILTER_BPF (this);
+  gsize capacity = loudnorm_ring_get_capacity (this->ring);
+  guint8 *scratch = g_malloc (capacity);
+
+  GST_DEBUG_OBJECT (this, "analysis thread started");
+
+  while (g_atomic_int_get (&this->analysis_running)) {
+    /* measure in chunks the size of the streaming buffers, so the gain
+     * is updated as often as in synchronous mode */
+    gsize chunk = g_atomic_int_get (&this->analysis_chunk);
+    gsize len = loudnorm_ring_read (this->ring, scratch,
+        MIN (MAX (chunk, bpf), capacity), bpf);
+
+    if (len == 0) {
+      g_mutex_lock (&this->analysis_lock);
+      if (g_atomic_int_get (&this->analysis_running))
+        g_cond_wait_until (&this->analysis_cond, &this->analysis_lock,
+            g_get_monotonic_time () + ANALYSIS_POLL_INTERVAL);
+      g_mutex_unlock (&this->analysis_lock);
+      continue;
+    }
+
+    gboolean silent;
+    double gain = gst_loudnorm_measure (this, scratch, len / bpf, &silent);
+
+    gst_loudnorm_publish_gain (this, gain, silent);
+  }
+
+  g_free (scratch);
+
+  GST_DEBUG_OBJECT (this, "analysis thread stopped");
+
+  return NULL;
+}
+
+static void
+gst_loudnorm_measure_worker (gpointer data, gpointer user_data)
+{
+  GstLoudnorm *this = GST_LOUDNORM (user_data);
+
+  this->measure_job (this->measure_job_data, GPOINTER_TO_UINT (data));
+
+  g_mutex_lock (&this->measure_lock);
+  if (--this->measure_pending == 0)
+    g_cond_signal (&this->measure_cond);
+  g_mutex_unlock (&this->measure_lock);
+}
+
+/* Meter runner: the pool filters all shards but the first, which the
+ * measuring thread does itself while it would wait anyway */
+static void
+gst_loudnorm_run_shards (LoudnormMeterJob job, void *job_data,
+    unsigned int n, void *user_data)
+{
+  GstLoudnorm *this = GST_LOUDNORM (user_data);
+
+  this->measure_job = job;
+  this->measure_job_data = job_data;
+
+  g_mutex_lock (&this->measure_lock);
+  this->measure_pending = n - 1;
+  g_mutex_unlock (&this->measure_lock);
+
+  for (guint i = 1; i < n; i++)
+    g_thread_pool_push (this->measure_pool, GUINT_TO_POINTER (i), NULL);
+
+  job (job_data, 0);
+
+  g_mutex_lock (&this->measure_lock);
+  while (this->measure_pending > 0)
+    g_cond_wait (&this->measure_cond, &this->measure_lock);
+  g_mutex_unlock (&this->measure_lock);
+}
+
+/* Splits the measurement of wide streams over measure-threads */
+static gboolean
+gst_loudnorm_shard_meter (GstLoudnorm * this)
+{
+  GError *error = NULL;
+  guint shards;
+
+  gst_loudnorm_stop_measure_pool (this);
+
+  if (this->measure_threads < 2 || GST_AUDIO_FILTER_CHANNELS (this) <= 4)
+    return TRUE;
+
+  this->measure_pool = g_thread_pool_new (gst_loudnorm_measure_worker, this,
+      this->measure_threads - 1, FALSE, &error);
+  if (this->measure_pool == NULL) {
+    GST_ERROR_OBJECT (this, "Failed to create the measure threads: %s",
+        error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  shards = loudnorm_meter_set_shards (this->meter, this->measure_threads,
+      gst_loudnorm_run_shards, this);
+  if (shards == 0) {
+    GST_ERROR_OBJECT (this, "Failed to allocate the meter shards");
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (this, "measuring %u channels in %u shards",
+      GST_AUDIO_FILTER_CHANNELS (this), shards);
+
+  return TRUE;
+}
+
+static void
+gst_loudnorm_stop_measure_pool (GstLoudnorm * this)
+{
+  if (this->measure_pool == NULL)
+    return;
+
+  g_thread_pool_free (this->measure_pool, FALSE, TRUE);
+  this->measure_pool = NULL;
+}
+
+static gboolean
+gst_loudnorm_start_analysis (GstLoudnorm * this)
+{
+  GError *error = NULL;
+  gsize capacity = (gsize) GST_AUDIO_FILTER_RATE (this) *
+      GST_AUDIO_FILTER_BPF (this) * ANALYSIS_RING_SECONDS;
+
+  this->ring = loudnorm_ring_new (capacity);
+  if (this->ring == NULL) {
+    GST_ERROR_OBJECT (this, "Failed to allocate analysis ring");
+    return FALSE;
+  }
+
+  gst_loudnorm_publish_gain (this, 0.0, FALSE);
+  g_atomic_int_set (&this->analysis_chunk, 0);
+  g_atomic_int_set (&this->analysis_running, TRUE);
+
+  this->analysis_thread = g_thread_try_new ("loudnorm-analysis",
+      gst_loudnorm_analysis_thread, this, &error);
+  if (this->analysis_thread == NULL) {
+    GST_ERROR_OBJECT (this, "Failed to start analysis thread: %s",
+        error->message);
+    g_error_free (error);
+    g_atomic_int_set (&this->analysis_running, FALSE);
+    g_clear_pointer (&this->ring, loudnorm_ring_free);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_loudnorm_stop_analysis (GstLoudnorm * this)
+{
+  if (this->analysis_thread == NULL)
+    return;
+
+  g_mutex_lock (&this->analysis_lock);
+  g_atomic_int_set (&this->analysis_running, FALSE);
+  g_cond_signal (&this->analysis_cond);
+  g_mutex_unlock (&this->analysis_lock);
+
+  g_thread_join (this->analysis_thread);
+  this->analysis_thread = NULL;
+
+  g_clear_pointer (&this->ring, loudnorm_ring_free);
+}
+
+/* Audio buffers have no fixed size. Pool buffers hold 100 ms, which
+ * covers live sources (10 ms by default) and the 1024 to 4096 frame
+ * buffers decoders push; anything larger gets a buffer of its own. */
+static guint
+gst_loudnorm_pool_size (const GstAudioInfo * info)
+{
+  return GST_AUDIO_INFO_BPF (info) * (GST_AUDIO_INFO_RATE (info) / 10);
+}
+
+static gboolean
+gst_loudnorm_decide_allocation (GstBaseTransform * trans, GstQuery * query)
+{
+  GstLoudnorm *this = GST_LOUDNORM (trans);
+  GstCaps *caps;
+  GstAudioInfo info;
+
+  /* make sure there is a pool entry large enough for our buffers, the
+   * parent creates the pool if downstream did not offer one */
+  gst_query_parse_allocation (query, &caps, NULL);
+  if (caps && gst_audio_info_from_caps (&info, caps)) {
+    guint wanted = gst_loudnorm_pool_size (&info);
+
+    if (gst_query_get_n_allocation_pools (query) > 0) {
+      GstBufferPool *pool;
+      guint size, min, max;
+
+      gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min,
+          &max);
+      gst_query_set_nth_allocation_pool (query, 0, pool, MAX (size, wanted),
+          min, max);
+      if (pool)
+        gst_object_unref (pool);
+    } else {
+      gst_query_add_allocation_pool (query, NULL, wanted, 0, 0);
+    }
+  }
+
+  if (!GST_BASE_TRANSFORM_CLASS (gst_loudnorm_parent_class)->decide_allocation
+      (trans, query))
+    return FALSE;
+
+  /* the parent only stores the pool after this returns, take the one it
+   * decided on from the query rather than the previous one */
+  gst_clear_object (&this->pool);
+  this->pool_size = 0;
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, &this->pool, NULL, NULL,
+        NULL);
+  if (this->pool) {
+    GstStructure *config = gst_buffer_pool_get_config (this->pool);
+    guint size = 0;
+
+    gst_buffer_pool_config_get_params (config, NULL, &size, NULL, NULL);
+    gst_structure_free (config);
+    this->pool_size = size;
+  }
+  GST_DEBUG_OBJECT (this, "output pool %p, %u byte buffers", this->pool,
+      this->pool_size);
+
+  return TRUE;
+}
+
+static gboolean
+gst_loudnorm_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstCaps *caps;
+  gboolean need_pool;
+  GstAudioInfo info;
+
+  /* in passthrough the parent forwards the query downstream */
+  if (!GST_BASE_TRANSFORM_CLASS (gst_loudnorm_parent_class)->propose_allocation
+      (trans, decide_query, query))
+    return FALSE;
+  if (decide_query == NULL || gst_query_get_n_allocation_pools (query) > 0)
+    return TRUE;
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+  if (caps == NULL || !gst_audio_info_from_caps (&info, caps))
+    return FALSE;
+
+  guint size = gst_loudnorm_pool_size (&info);
+  GstBufferPool *pool = NULL;
+
+  if (need_pool) {
+    pool = gst_buffer_pool_new ();
+
+    GstStructure *config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, size, 0, 0);
+    if (!gst_buffer_pool_set_config (pool, config)) {
+      gst_object_unref (pool);
+      return FALSE;
+    }
+  }
+
+  gst_query_add_allocation_pool (query, pool, size, 0, 0);
+  if (pool)
+    gst_object_unref (pool);
+
+  return TRUE;
+}
+
+/* Writable input is scaled in place. Shared input is read once and
+ * written scaled into a buffer from the pool, instead of being copied by
+ * the base class first and rewritten afterwards. */
+static GstFlowReturn
+gst_loudnorm_prepare_output_buffer (GstBaseTransform * trans,
+    GstBuffer * inbuf, GstBuffer ** outbuf)
+{
+  GstLoudnorm *this = GST_LOUDNORM (trans);
+
+  if (gst_base_transform_is_passthrough (trans)
+      || gst_buffer_is_writable (inbuf)) {
+    *outbuf = inbuf;
+    return GST_FLOW_OK;
+  }
+
+  gsize size = gst_buffer_get_size (inbuf);
+
+  if (this->pool && size <= this->pool_size) {
+    if (!gst_buffer_pool_is_active (this->pool)
+        && !gst_buffer_pool_set_active (this->pool, TRUE)) {
+      GST_ELEMENT_ERROR (this, RESOURCE, SETTINGS, (NULL),
+          ("Failed to activate the output buffer pool"));
+      return GST_FLOW_ERROR;
+    }
+
+    GstFlowReturn ret = gst_buffer_pool_acquire_buffer (this->pool, outbuf,
+        NULL);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    gst_buffer_resize (*outbuf, 0, size);
+  } else {
+    GST_LOG_OBJECT (this, "%" G_GSIZE_FORMAT " byte buffer does not fit the "
+        "pool", size);
+    *outbuf = gst_buffer_new_allocate (NULL, size, NULL);
+  }
+
+  GstBaseTransformClass *klass = GST_BASE_TRANSFORM_GET_CLASS (trans);
+  if (klass->copy_metadata && !klass->copy_metadata (trans, inbuf, *outbuf))
+    GST_WARNING_OBJECT (this, "Failed to copy the buffer metadata");
+
+  return GST_FLOW_OK;
+}
+
+/* The limiter hands out the frames it took in latency frames ago. outbuf
+ * gets their time, which the latency query accounts for, and loses the
+ * frames of silence the delay line started with. */
+static GstFlowReturn
+gst_loudnorm_delay_timestamps (GstLoudnorm * this, GstBuffer * outbuf,
+    guint frames)
+{
+  guint rate = GST_AUDIO_FILTER_RATE (this);
+  guint bpf = GST_AUDIO_FILTER_BPF (this);
+  guint latency = g_atomic_int_get (&this->latency);
+  guint skip = MIN (this->limiter_skip, frames);
+  GstClockTime pts = GST_BUFFER_PTS (outbuf);
+
+  this->limiter_skip -= skip;
+  if (GST_CLOCK_TIME_IS_VALID (pts))
+    this->limiter_end = pts + gst_util_uint64_scale_int (frames, GST_SECOND,
+        rate);
+
+  if (skip == frames)
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  if (skip > 0)
+    gst_buffer_resize (outbuf, (gssize) skip * bpf,
+        (gssize) (frames - skip) * bpf);
+
+  /* the first frame left is the one that came in latency - skip frames
+   * before this buffer */
+  if (GST_CLOCK_TIME_IS_VALID (pts)) {
+    GstClockTime shift = gst_util_uint64_scale_int (latency - skip,
+        GST_SECOND, rate);
+
+    GST_BUFFER_PTS (outbuf) = pts > shift ? pts - shift : 0;
+    GST_BUFFER_DURATION (outbuf) = gst_util_uint64_scale_int (frames - skip,
+        GST_SECOND, rate);
+  }
+  if (GST_BUFFER_OFFSET_IS_VALID (outbuf)) {
+    guint64 offset = GST_BUFFER_OFFSET (outbuf);
+
+    GST_BUFFER_OFFSET (outbuf) = offset > latency - skip ?
+        offset - (latency - skip) : 0;
+    GST_BUFFER_OFFSET_END (outbuf) = GST_BUFFER_OFFSET (outbuf) +
+        (frames - skip);
+  }
+
   return GST_FLOW_OK;
 }
 
+/* Measures inbuf and writes the scaled samples to outbuf, which is inbuf
+ * itself when the transform runs in place */
+static GstFlowReturn
+gst_loudnorm_process (GstLoudnorm * this, GstBuffer * inbuf,
+    GstBuffer * outbuf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (this);
+
+  /* in passthrough the buffer may be shared, so only read it */
+  gboolean passthrough = gst_base_transform_is_passthrough (trans);
+  gboolean in_place = inbuf == outbuf;
+
+  GstMapInfo map, out_map;
+  if (!gst_buffer_map (inbuf, &map,
+          passthrough || !in_place ? GST_MAP_READ : GST_MAP_READWRITE)) {
+    GST_ERROR_OBJECT (this, "Failed to map buffer");
+    return GST_FLOW_ERROR;
+  }
+  if (!in_place && !gst_buffer_map (outbuf, &out_map, GST_MAP_WRITE)) {
+    gst_buffer_unmap (inbuf, &map);
+    GST_ERROR_OBJECT (this, "Failed to map output buffer");
+    return GST_FLOW_ERROR;
+  }
+  guint8 *dst = in_place ? map.data : out_map.data;
+
+  GstAudioFormat format = GST_AUDIO_FILTER_FORMAT (this);
+  guint bpf = GST_AUDIO_FILTER_BPF (this);
+
+  if (bpf == 0) {
+    if (!in_place)
+      gst_buffer_unmap (outbuf, &out_map);
+    gst_buffer_unmap (inbuf, &map);
+    GST_ELEMENT_ERROR (this, CORE, NEGOTIATION, (NULL), ("No caps set"));
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  guint frames = map.size / bpf;
+  guint samples = frames * GST_AUDIO_FILTER_CHANNELS (this);
+
+  guint64 start = stats_now ();
+  double gain = 0.0;
+  gboolean silent = FALSE;
+  gboolean measured = FALSE;
+  gboolean capped = FALSE;
+  /* the processor saw this buffer here and may know its peak */
+  gboolean scanned = FALSE;
+  gsize clipped = 0;
+
+  if (this->mode == GST_LOUDNORM_MODE_ANALYZE) {
+    // a cached stream needs no measurement
+    if (this->cache_entry == NULL) {
+      gst_loudnorm_add_frames_timeline (this, format, map.data, frames);
+      STATS_ADD (this, ebur128_time, stats_now () - start);
+    }
+  } else if (this->cache_entry && isfinite (this->cache_entry->integrated)) {
+    gain = gst_loudnorm_static_gain (this, this->cache_entry->integrated,
+        frames);
+  } else if (this->mode == GST_LOUDNORM_MODE_APPLY) {
+    // second pass, a static gain and no measurement at all
+    gain = gst_loudnorm_static_gain (this,
+        params_get_float (&this->measured_loudness), frames);
+  } else if (this->analysis_thread) {
+    // the analysis thread only needs whole frames, drop what doesn't fit
+    gsize len = (gsize) frames * bpf;
+
+    g_atomic_int_set (&this->analysis_chunk, len);
+    if (loudnorm_ring_write (this->ring, map.data, len, bpf) < len)
+      GST_WARNING_OBJECT (this, "Analysis is falling behind, dropping samples");
+
+    gain = gst_loudnorm_get_published_gain (this);
+    silent = g_atomic_int_get (&this->published_silent);
+    measured = TRUE;
+  } else {
+    gain = gst_loudnorm_measure (this, map.data, frames, &silent);
+    capped = loudnorm_processor_gain_is_capped (this->processor);
+    measured = TRUE;
+    scanned = TRUE;
+  }
+
+  /* static gains are held to the true-peak ceiling here, and so are those
+   * of the analysis thread, against these frames rather than the earlier
+   * ones it measured. The processor caps what it measures itself. */
+  if (this->mode != GST_LOUDNORM_MODE_ANALYZE &&
+      (!measured || this->analysis_thread)) {
+    gain = loudnorm_processor_cap_true_peak (this->processor, map.data,
+        frames, gain);
+    capped = loudnorm_processor_gain_is_capped (this->processor);
+    scanned = TRUE;
+  }
+
+  // silence goes out untouched, no point in scaling the noise floor, but
+  // it still has to pass the delay of the limiter
+  gboolean limited = g_atomic_int_get (&this->latency) > 0;
+
+  if (limited && silent) {
+    gain = 0.0;
+    silent = FALSE;
+  }
+
+  if (!passthrough && !silent) {
+    guint64 gain_start = stats_now ();
+
+    /* small changes go in one step, larger ones are spread across the
+     * buffer. A gain capped for the true peak has to hold from the first
+     * frame, and so does one the ramp would start too high for. */
+    if (isnan (this->applied_gain) || capped
+        || fabs (gain - this->applied_gain) < MIN_GAIN_RAMP
+        || this->applied_gain >
+        loudnorm_processor_get_gain_limit (this->processor))
+      clipped = loudnorm_processor_apply (this->processor, map.data, dst,
+          frames, gain);
+    else
+      clipped = loudnorm_processor_apply_ramp (this->processor, map.data,
+          dst, frames, this->applied_gain, gain);
+    this->applied_gain = gain;
+
+    STATS_ADD (this, gain_time, stats_now () - gain_start);
+    STATS_ADD (this, clipped_samples, clipped);
+  } else {
+    if (!in_place)
+      memcpy (dst, map.data, MIN (map.size, out_map.size));
+    this->applied_gain = 0.0;
+  }
+
+  /* a shared buffer in passthrough can't take metadata */
+  if (gst_buffer_is_writable (outbuf)) {
+    GstLoudnormMeta *meta = gst_buffer_add_loudnorm_meta (outbuf);
+
+    meta->shortterm_loudness = measured ?
+        stats_get_double (&this->stats.shortterm_loudness) : NAN;
+    meta->momentary_loudness = measured ?
+        stats_get_double (&this->stats.momentary_loudness) : NAN;
+    meta->gain = passthrough || silent ? 0.0 : gain;
+    /* the silence check, the meter or the true-peak cap usually found
+     * the peak already */
+    if (!scanned
+        || !loudnorm_processor_get_last_peak (this->processor, &meta->peak))
+      meta->peak = loudnorm_processor_peak (this->processor, map.data,
+          frames);
+    meta->clipped = clipped > 0;
+  }
+
+  //unmap the buffers
+  if (!in_place)
+    gst_buffer_unmap (outbuf, &out_map);
+  gst_buffer_unmap (inbuf, &map);
+
+  guint64 end = stats_now ();
+
+  STATS_ADD (this, buffers, 1);
+  STATS_ADD (this, samples, samples);
+  if (end - start > this->stats.max_latency)
+    STATS_SET (this, max_latency, end - start);
+  stats_set_double (&this->stats.gain, passthrough || silent ? 0.0 : gain);
+  gst_loudnorm_post_stats (this, end);
+
+  /* The smoothed gain is continuous, so switching at the tolerance keeps
+   * the step between the applied gain and unity below the tolerance in
+   * both directions. The switch takes effect from the next buffer. */
+  gboolean unity = this->mode == GST_LOUDNORM_MODE_ANALYZE ||
+      (!limited && fabs (gain) < this->unity_tolerance);
+
+  GstFlowReturn ret = limited ?
+      gst_loudnorm_delay_timestamps (this, outbuf, frames) : GST_FLOW_OK;
+
+  if (unity != passthrough) {
+    GST_DEBUG_OBJECT (this, "gain %.2f dB, %s passthrough", gain,
+        unity ? "entering" : "leaving");
+    gst_base_transform_set_passthrough (trans, unity);
+  }
+  
+  return ret;
+}
+
+static GstFlowReturn
+gst_loudnorm_transform (GstBaseTransform * trans, GstBuffer * inbuf,
+    GstBuffer * outbuf)
+{
+  GST_DEBUG_OBJECT (trans, "transform");
+
+  return gst_loudnorm_process (GST_LOUDNORM (trans), inbuf, outbuf);
+}
+
+static GstFlowReturn
+gst_loudnorm_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GST_DEBUG_OBJECT (trans, "transform_ip");
+
+  return gst_loudnorm_process (GST_LOUDNORM (trans), buf, buf);
+}
+
 static gboolean
 plugin_init (GstPlugin * plugin)
 {
+  /* registered up front, so applications can look the type up by name */
+  gst_loudnorm_meta_get_info ();
+
   return gst_element_register (plugin, "loudnorm", GST_RANK_NONE,
-      GST_TYPE_LOUDNORM);
+      GST_TYPE_LOUDNORM)
+      && gst_element_register (plugin, "loudnormmux", GST_RANK_NONE,
+      GST_TYPE_LOUDNORM_MUX);
 }
 
 
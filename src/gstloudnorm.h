@@ -21,7 +21,14 @@
 #define _GST_LOUDNORM_H_
 
 #include <gst/audio/gstaudiofilter.h>
+#ifndef LOUDNORM_INTERNAL_METER
 #include <ebur128.h>
+#endif
+#include "loudnormring.h"
+#include "loudnormcache.h"
+#include "loudnormpool.h"
+#include "loudnormprocessor.h"
+#include "loudnormsmoother.h"
 
 G_BEGIN_DECLS
 
@@ -30,29 +37,132 @@ G_BEGIN_DECLS
 #define GST_LOUDNORM_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_LOUDNORM,GstLoudnormClass))
 #define GST_IS_LOUDNORM(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_LOUDNORM))
 #define GST_IS_LOUDNORM_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_LOUDNORM))
-#define QUEUE_SIZE 20
-#define FILTER_SIZE 20
-#define FILTER_SIGMA 1.7
 
-typedef struct _GstLoudnorm GstLoudnorm;
-typedef struct _GstLoudnormClass GstLoudnormClass;
+#define GST_TYPE_LOUDNORM_MODE (gst_loudnorm_mode_get_type())
 
+typedef enum {
+  GST_LOUDNORM_MODE_REALTIME,
+  GST_LOUDNORM_MODE_ANALYZE,
+  GST_LOUDNORM_MODE_APPLY
+} GstLoudnormMode;
+
+/* Runtime statistics. Every field has a single writer thread and is
+ * accessed with relaxed atomics, so readers never take a lock. */
 typedef struct {
-    double data[QUEUE_SIZE];
-    int front;
-    int rear;
-    int size;
-} Queue;
+  guint64 buffers;
+  guint64 samples;
+  guint64 ebur128_time;         /* ns */
+  guint64 gain_time;            /* ns */
+  guint64 max_latency;          /* ns */
+  guint64 clipped_samples;
+  gdouble shortterm_loudness;   /* LUFS */
+  gdouble momentary_loudness;   /* LUFS */
+  gdouble gain;                 /* dB */
+} GstLoudnormStats;
+
+typedef struct _GstLoudnorm GstLoudnorm;
+typedef struct _GstLoudnormClass GstLoudnormClass;
 
 struct _GstLoudnorm
 {
   GstAudioFilter base_loudnorm;
+#ifndef LOUDNORM_INTERNAL_METER
   ebur128_state *ebur128_state;
+  int ebur128_mode;
+#endif
+  /* the realtime gain, its meter also measures the analyze pass without
+   * ebur128. Taken from the process-wide pool for processor_key. */
+  LoudnormProcessor *processor;
+  LoudnormPoolKey processor_key;
+  LoudnormMeter *meter;
+  guint64 measured_frames;
+
+  /* memory bounds of the ebur128 state */
+  gboolean bounded_memory;
+  guint max_history;
+  guint max_window;
+
+  /* rate of the realtime measurement, 0 for the stream rate */
+  guint measure_rate;
+
+  /* measure-threads: the meter shards beyond the first are filtered on
+   * measure_pool while the measuring thread waits for measure_pending */
+  guint measure_threads;
+  GThreadPool *measure_pool;
+  LoudnormMeterJob measure_job;
+  gpointer measure_job_data;
+  gint measure_pending;
+  GMutex measure_lock;
+  GCond measure_cond;
   float target_loudness;
   float target_lra;
   float silence_threshold;
-  Queue gain_history;
-  double kernel[FILTER_SIZE];
+  float unity_tolerance;
+  GstLoudnormMode mode;
+  float measured_loudness;
+  double integrated_loudness;
+  double loudness_range;
+
+  /* analysis cache, keyed by cache-key or the stream-id */
+  gchar *cache_dir;
+  gchar *cache_key;
+  gboolean cache_timeline;
+  gchar *stream_id;
+  LoudnormCacheEntry *cache_entry;
+  GArray *timeline;
+  guint64 timeline_frames;
+  float attack_time;
+  float release_time;
+
+  /* The settings above that can change while playing are stored
+   * atomically and announced by params_serial. The measuring thread
+   * compares it with params_seen per buffer and ramps the targets over
+   * ramp_time. */
+  gint params_serial;
+  gint params_seen;
+  float ramp_time;
+  /* apply and cached gains, ramped by the streaming thread */
+  LoudnormRamp static_gain;
+  /* dB at the end of the last buffer, NAN before the first one */
+  double applied_gain;
+
+  /* lookahead limiter, latency is its delay in frames (0 when off).
+   * limiter_skip frames of the delay line still hold the silence it
+   * started with, limiter_end is the end of the last input buffer, up
+   * to which the drain reaches at EOS. */
+  gboolean limiter;
+  float lookahead;
+  float ceiling;
+  gint latency;
+  /* dBTP, 0 when off */
+  float true_peak_ceiling;
+  guint limiter_skip;
+  GstClockTime limiter_end;
+
+  /* warm start file of the realtime gain */
+  gchar *state_location;
+
+  GstLoudnormStats stats;
+  guint stats_interval;
+  guint64 stats_last_post;
+
+  /* async-measure: samples go through the ring to the analysis thread,
+   * which publishes the smoothed gain (float bits, in dB) and whether
+   * the input is silent. The true-peak cap stays on the streaming
+   * thread. */
+  gboolean async_measure;
+  LoudnormRing *ring;
+  GThread *analysis_thread;
+  gint analysis_running;
+  gint analysis_chunk;
+  gint published_gain;
+  gint published_silent;
+  GMutex analysis_lock;
+  GCond analysis_cond;
+
+  /* output buffers for shared input, from the negotiated pool */
+  GstBufferPool *pool;
+  guint pool_size;
 };
 
 struct _GstLoudnormClass
@@ -61,6 +171,7 @@ struct _GstLoudnormClass
 };
 
 GType gst_loudnorm_get_type (void);
+GType gst_loudnorm_mode_get_type (void);
 
 G_END_DECLS
 
@@ -0,0 +1,109 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * The meta is tagged as audio only, so plain audio filters further down
+ * (audioconvert, volume, ...) keep it, while elements that change more
+ * than the samples drop it. Copies carry the values along.
+ */
+
+#include "gstloudnormmeta.h"
+
+#include <math.h>
+
+GType
+gst_loudnorm_meta_api_get_type (void)
+{
+  static GType type = 0;
+  static const gchar *tags[] = { GST_META_TAG_AUDIO_STR, NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register (GST_LOUDNORM_META_API_NAME,
+        tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_loudnorm_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstLoudnormMeta *lmeta = (GstLoudnormMeta *) meta;
+
+  lmeta->shortterm_loudness = NAN;
+  lmeta->momentary_loudness = NAN;
+  lmeta->gain = 0.0;
+  lmeta->peak = 0.0;
+  lmeta->clipped = FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_loudnorm_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstLoudnormMeta *src = (GstLoudnormMeta *) meta;
+  GstLoudnormMeta *dmeta;
+
+  /* the values describe the samples, only copies keep them */
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  dmeta = gst_buffer_add_loudnorm_meta (dest);
+  if (dmeta == NULL)
+    return FALSE;
+
+  dmeta->shortterm_loudness = src->shortterm_loudness;
+  dmeta->momentary_loudness = src->momentary_loudness;
+  dmeta->gain = src->gain;
+  dmeta->peak = src->peak;
+  dmeta->clipped = src->clipped;
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_loudnorm_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi = gst_meta_register (GST_LOUDNORM_META_API_TYPE,
+        "GstLoudnormMeta", sizeof (GstLoudnormMeta),
+        gst_loudnorm_meta_init, NULL, gst_loudnorm_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+GstLoudnormMeta *
+gst_buffer_add_loudnorm_meta (GstBuffer * buffer)
+{
+  GstLoudnormMeta *meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  meta = gst_buffer_get_loudnorm_meta (buffer);
+  if (meta == NULL)
+    meta = (GstLoudnormMeta *) gst_buffer_add_meta (buffer,
+        GST_LOUDNORM_META_INFO, NULL);
+
+  return meta;
+}
@@ -0,0 +1,78 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_LOUDNORM_META_H_
+#define _GST_LOUDNORM_META_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Name of the API type. The element lives in a plugin, so applications
+ * and other plugins look the type up by name instead of linking to it:
+ * gst_buffer_get_meta (buffer, g_type_from_name (...)). */
+#define GST_LOUDNORM_META_API_NAME "GstLoudnormMetaAPI"
+
+#define GST_LOUDNORM_META_API_TYPE (gst_loudnorm_meta_api_get_type())
+#define GST_LOUDNORM_META_INFO (gst_loudnorm_meta_get_info())
+
+typedef struct _GstLoudnormMeta GstLoudnormMeta;
+
+/**
+ * GstLoudnormMeta:
+ * @meta: parent #GstMeta
+ * @shortterm_loudness: short-term loudness before the gain in LUFS, as of
+ *     the last measurement that was not silent. NAN when the element did
+ *     not measure, in analyze and apply mode or with a cached gain.
+ * @momentary_loudness: momentary loudness before the gain in LUFS, same
+ *     rules
+ * @gain: gain applied to the buffer in dB, 0.0 for silence and
+ *     passthrough
+ * @peak: largest absolute sample of the buffer before the gain, 1.0 being
+ *     full scale. For the frames the limiter pushes out on EOS, the peak
+ *     of its output with the gain divided back out.
+ * @clipped: whether the gain pushed samples beyond full scale
+ *
+ * What loudnorm measured and did to a buffer, so that elements further
+ * down don't have to measure the same signal again.
+ */
+struct _GstLoudnormMeta
+{
+  GstMeta meta;
+
+  gdouble shortterm_loudness;
+  gdouble momentary_loudness;
+  gdouble gain;
+  gdouble peak;
+  gboolean clipped;
+};
+
+GType gst_loudnorm_meta_api_get_type (void);
+const GstMetaInfo *gst_loudnorm_meta_get_info (void);
+
+#define gst_buffer_get_loudnorm_meta(b) \
+  ((GstLoudnormMeta *) gst_buffer_get_meta ((b), GST_LOUDNORM_META_API_TYPE))
+
+/* Returns the meta already on buffer or adds a new one, buffer must be
+ * writable */
+GstLoudnormMeta *gst_buffer_add_loudnorm_meta (GstBuffer * buffer);
+
+G_END_DECLS
+
+#endif
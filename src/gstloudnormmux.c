@@ -0,0 +1,888 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstloudnormmux
+ *
+ * The loudnormmux element normalizes many mono streams at once. Every
+ * request pad takes one stream and becomes one channel of the
+ * interleaved output, in the order the pads were requested. Each stream
+ * gets its own realtime gain with its own target-loudness and target-lra,
+ * set on the pad, the same gain a loudnorm element in realtime mode
+ * would apply with the default silence threshold and times. The pads are
+ * the children of the element, so their properties can be set on it as
+ * sink_N::property, as in the launch line below.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 loudnormmux name=mux sink_1::target-loudness=-16 ! \
+ *  deinterleave name=d \
+ *  filesrc location=a.wav ! wavparse ! mux.sink_0 \
+ *  filesrc location=b.wav ! wavparse ! mux.sink_1 \
+ *  d.src_0 ! queue ! wavenc ! filesink location=a-norm.wav \
+ *  d.src_1 ! queue ! wavenc ! filesink location=b-norm.wav
+ * ]|
+ * All streams need the same format and a rate of 8 kHz or above.
+ *
+ * A loudnorm element per stream costs a streaming thread and a buffer
+ * round trip per stream. Here one aggregate thread collects a block of
+ * every stream into a row of its own, then the rows are normalized in
+ * batches on threads workers, one batch each, and interleaved into the
+ * output buffer. Streams without data for a block are normalized as
+ * silence.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/audio/gstaudioaggregator.h>
+#include "gstloudnormmux.h"
+#include <string.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_loudnorm_mux_debug_category);
+#define GST_CAT_DEFAULT gst_loudnorm_mux_debug_category
+
+enum
+{
+  PROP_0,
+  PROP_THREADS
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_TARGET_LOUDNESS,
+  PROP_PAD_TARGET_LRA
+};
+
+#define DEFAULT_TARGET_LOUDNESS -23.0
+#define DEFAULT_TARGET_LRA 7.0
+/* the defaults of the loudnorm element */
+#define DEFAULT_SILENCE_THRESHOLD -50.0
+#define DEFAULT_ATTACK_TIME 100.0
+#define DEFAULT_RELEASE_TIME 500.0
+/* ms of audio a stream takes to reach new targets */
+#define TARGET_RAMP_MS 500.0
+
+#define LOUDNORM_MUX_FORMATS "{ F32LE, S32LE, S16LE }"
+
+static GstStaticPadTemplate gst_loudnorm_mux_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " LOUDNORM_MUX_FORMATS ", "
+        "channels = (int) [ 1, MAX ], "
+        "rate = (int) [ 8000, MAX ], " "layout = (string) interleaved")
+  );
+
+static GstStaticPadTemplate gst_loudnorm_mux_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " LOUDNORM_MUX_FORMATS ", "
+        "channels = (int) 1, "
+        "rate = (int) [ 8000, MAX ], " "layout = (string) interleaved")
+  );
+
+/* pad */
+
+G_DEFINE_TYPE (GstLoudnormMuxPad, gst_loudnorm_mux_pad,
+    GST_TYPE_AUDIO_AGGREGATOR_PAD);
+
+static void
+gst_loudnorm_mux_pad_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstLoudnormMuxPad *pad = GST_LOUDNORM_MUX_PAD (object);
+
+  switch (property_id) {
+    case PROP_PAD_TARGET_LOUDNESS:
+      GST_OBJECT_LOCK (pad);
+      pad->target_loudness = g_value_get_float (value);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    case PROP_PAD_TARGET_LRA:
+      GST_OBJECT_LOCK (pad);
+      pad->target_lra = g_value_get_float (value);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      return;
+  }
+  g_atomic_int_inc (&pad->params_serial);
+}
+
+static void
+gst_loudnorm_mux_pad_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstLoudnormMuxPad *pad = GST_LOUDNORM_MUX_PAD (object);
+
+  GST_OBJECT_LOCK (pad);
+  switch (property_id) {
+    case PROP_PAD_TARGET_LOUDNESS:
+      g_value_set_float (value, pad->target_loudness);
+      break;
+    case PROP_PAD_TARGET_LRA:
+      g_value_set_float (value, pad->target_lra);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static void
+gst_loudnorm_mux_pad_finalize (GObject * object)
+{
+  GstLoudnormMuxPad *pad = GST_LOUDNORM_MUX_PAD (object);
+
+  /* normally handed back to the pool when the pad is released */
+  loudnorm_processor_free (pad->processor);
+
+  G_OBJECT_CLASS (gst_loudnorm_mux_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_loudnorm_mux_pad_class_init (GstLoudnormMuxPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->set_property = gst_loudnorm_mux_pad_set_property;
+  gobject_class->get_property = gst_loudnorm_mux_pad_get_property;
+  gobject_class->finalize = gst_loudnorm_mux_pad_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_TARGET_LOUDNESS,
+      g_param_spec_float ("target-loudness", "Target Loudness",
+          "Target loudness of the stream in LUFS", -99.0, 0.0,
+          DEFAULT_TARGET_LOUDNESS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_PAD_TARGET_LRA,
+      g_param_spec_float ("target-lra", "Target LRA",
+          "Target loudness range of the stream in LU", 1.0, 20.0,
+          DEFAULT_TARGET_LRA,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_loudnorm_mux_pad_init (GstLoudnormMuxPad * pad)
+{
+  pad->target_loudness = DEFAULT_TARGET_LOUDNESS;
+  pad->target_lra = DEFAULT_TARGET_LRA;
+  pad->channel = G_MAXUINT;
+}
+
+/* Ramps the processor to targets changed since the last block */
+static void
+gst_loudnorm_mux_pad_update (GstLoudnormMuxPad * pad)
+{
+  gint serial = g_atomic_int_get (&pad->params_serial);
+  float loudness, lra;
+
+  if (serial == pad->params_seen)
+    return;
+  pad->params_seen = serial;
+
+  GST_OBJECT_LOCK (pad);
+  loudness = pad->target_loudness;
+  lra = pad->target_lra;
+  GST_OBJECT_UNLOCK (pad);
+
+  loudnorm_processor_ramp_target (pad->processor, loudness, lra,
+      TARGET_RAMP_MS);
+}
+
+/* element */
+
+static void gst_loudnorm_mux_child_proxy_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (GstLoudnormMux, gst_loudnorm_mux,
+    GST_TYPE_AUDIO_AGGREGATOR,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_CHILD_PROXY,
+        gst_loudnorm_mux_child_proxy_init);
+    GST_DEBUG_CATEGORY_INIT (gst_loudnorm_mux_debug_category, "loudnormmux",
+        0, "debug category for loudnormmux element"));
+
+static LoudnormFormat
+gst_loudnorm_mux_processor_format (GstAudioFormat format)
+{
+  switch (format) {
+    case GST_AUDIO_FORMAT_S16LE:
+      return LOUDNORM_FORMAT_S16;
+    case GST_AUDIO_FORMAT_S32LE:
+      return LOUDNORM_FORMAT_S32;
+    case GST_AUDIO_FORMAT_F32LE:
+      return LOUDNORM_FORMAT_F32;
+    default:
+      g_assert_not_reached ();
+      return LOUDNORM_FORMAT_S16;
+  }
+}
+
+/* Drops the stream list, with streams_lock held. The processors go back
+ * to the pool when release is set, otherwise the pads keep them. */
+static void
+gst_loudnorm_mux_clear_streams (GstLoudnormMux * this, gboolean release)
+{
+  for (guint c = 0; c < this->streams->len; c++) {
+    GstLoudnormMuxPad *pad = g_ptr_array_index (this->streams, c);
+
+    if (pad == NULL)
+      continue;
+    if (release) {
+      loudnorm_pool_release (&this->processor_key, pad->processor);
+      pad->processor = NULL;
+    }
+    pad->channel = G_MAXUINT;
+    gst_object_unref (pad);
+  }
+  g_ptr_array_set_size (this->streams, 0);
+
+  g_clear_pointer (&this->planes, g_free);
+  this->plane_frames = 0;
+}
+
+/* Rows of at least frames, zeroed, for the current streams */
+static gboolean
+gst_loudnorm_mux_ensure_planes (GstLoudnormMux * this, gsize frames)
+{
+  if (frames <= this->plane_frames)
+    return TRUE;
+
+  g_free (this->planes);
+  this->planes = g_try_malloc0 (frames * this->streams->len * this->bps);
+  this->plane_frames = this->planes ? frames : 0;
+
+  return this->planes != NULL;
+}
+
+static void
+gst_loudnorm_mux_run_batch (GstLoudnormMux * this, guint index)
+{
+  guint first = index * this->batch_streams;
+  guint last = MIN (first + this->batch_streams, this->streams->len);
+  gsize row = this->plane_frames * this->bps;
+
+  for (guint c = first; c < last; c++) {
+    GstLoudnormMuxPad *pad = g_ptr_array_index (this->streams, c);
+    guint8 *data = this->planes + c * row;
+
+    if (pad == NULL || pad->processor == NULL)
+      continue;
+
+    gst_loudnorm_mux_pad_update (pad);
+    loudnorm_processor_process (pad->processor, data, data,
+        this->batch_frames, NULL);
+  }
+}
+
+static void
+gst_loudnorm_mux_worker (gpointer data, gpointer user_data)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (user_data);
+
+  gst_loudnorm_mux_run_batch (this, GPOINTER_TO_UINT (data));
+
+  g_mutex_lock (&this->batch_lock);
+  if (--this->batch_pending == 0)
+    g_cond_signal (&this->batch_cond);
+  g_mutex_unlock (&this->batch_lock);
+}
+
+/* Normalizes frames of every row, one batch of streams per thread */
+static void
+gst_loudnorm_mux_process (GstLoudnormMux * this, gsize frames)
+{
+  guint streams = this->streams->len;
+  guint batches = this->pool ?
+      MIN (g_thread_pool_get_max_threads (this->pool) + 1, streams) : 1;
+
+  this->batch_frames = frames;
+  this->batch_streams = (streams + batches - 1) / batches;
+  batches = (streams + this->batch_streams - 1) / this->batch_streams;
+
+  g_mutex_lock (&this->batch_lock);
+  this->batch_pending = batches - 1;
+  g_mutex_unlock (&this->batch_lock);
+
+  for (guint i = 1; i < batches; i++)
+    g_thread_pool_push (this->pool, GUINT_TO_POINTER (i), NULL);
+
+  gst_loudnorm_mux_run_batch (this, 0);
+
+  g_mutex_lock (&this->batch_lock);
+  while (this->batch_pending > 0)
+    g_cond_wait (&this->batch_cond, &this->batch_lock);
+  g_mutex_unlock (&this->batch_lock);
+}
+
+#define DEFINE_INTERLEAVE(name, type)                                        \
+static void                                                                  \
+name (type * out, const type * planes, gsize row, guint channels,            \
+    gsize frames)                                                            \
+{                                                                            \
+  for (guint c = 0; c < channels; c++) {                                     \
+    const type *in = planes + c * row;                                       \
+                                                                             \
+    for (gsize i = 0; i < frames; i++)                                       \
+      out[i * channels + c] = in[i];                                         \
+  }                                                                          \
+}
+
+DEFINE_INTERLEAVE (interleave_16, guint16)
+DEFINE_INTERLEAVE (interleave_32, guint32)
+
+static void
+gst_loudnorm_mux_interleave (GstLoudnormMux * this, gpointer out,
+    gsize frames)
+{
+  if (this->bps == 2)
+    interleave_16 (out, (const guint16 *) this->planes, this->plane_frames,
+        this->streams->len, frames);
+  else
+    interleave_32 (out, (const guint32 *) this->planes, this->plane_frames,
+        this->streams->len, frames);
+}
+
+/* Gathers the frames of one pad into its row, the output is written
+ * once all streams are normalized */
+static gboolean
+gst_loudnorm_mux_aggregate_one_buffer (GstAudioAggregator * aagg,
+    GstAudioAggregatorPad * aaggpad, GstBuffer * inbuf, guint in_offset,
+    GstBuffer * outbuf, guint out_offset, guint num_frames)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (aagg);
+  GstLoudnormMuxPad *pad = GST_LOUDNORM_MUX_PAD (aaggpad);
+  gboolean written = FALSE;
+  GstMapInfo map;
+
+  g_mutex_lock (&this->streams_lock);
+  if (pad->channel >= this->streams->len)
+    goto done;
+  if (!gst_loudnorm_mux_ensure_planes (this, gst_buffer_get_size (outbuf) /
+          (this->bps * this->streams->len)))
+    goto done;
+  if (out_offset + num_frames > this->plane_frames)
+    goto done;
+  if (!gst_buffer_map (inbuf, &map, GST_MAP_READ))
+    goto done;
+
+  memcpy (this->planes + (pad->channel * this->plane_frames + out_offset) *
+      this->bps, map.data + (gsize) in_offset * this->bps,
+      (gsize) num_frames * this->bps);
+  gst_buffer_unmap (inbuf, &map);
+  written = TRUE;
+
+done:
+  g_mutex_unlock (&this->streams_lock);
+  return written;
+}
+
+static GstFlowReturn
+gst_loudnorm_mux_finish_buffer (GstAggregator * agg, GstBuffer * buffer)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (agg);
+  GstMapInfo map;
+
+  g_mutex_lock (&this->streams_lock);
+  if (this->streams->len > 0 && this->planes &&
+      gst_buffer_map (buffer, &map, GST_MAP_WRITE)) {
+    gsize frames = MIN (map.size / (this->bps * this->streams->len),
+        this->plane_frames);
+
+    gst_loudnorm_mux_process (this, frames);
+    gst_loudnorm_mux_interleave (this, map.data, frames);
+    gst_buffer_unmap (buffer, &map);
+
+    /* streams without data in the next block are silent */
+    memset (this->planes, 0,
+        this->plane_frames * this->streams->len * this->bps);
+  }
+  g_mutex_unlock (&this->streams_lock);
+
+  return GST_AGGREGATOR_CLASS (gst_loudnorm_mux_parent_class)->finish_buffer
+      (agg, buffer);
+}
+
+/* All streams share the format and rate of the first, without a channel
+ * mask */
+static gboolean
+gst_loudnorm_mux_setcaps (GstLoudnormMux * this, GstAggregatorPad * pad,
+    GstCaps * caps)
+{
+  gboolean ret = TRUE;
+  GstAudioInfo info;
+
+  if (!gst_audio_info_from_caps (&info, caps)) {
+    GST_WARNING_OBJECT (pad, "invalid caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  GST_OBJECT_LOCK (this);
+  if (this->sinkcaps && !gst_caps_is_subset (caps, this->sinkcaps)) {
+    ret = FALSE;
+  } else if (this->sinkcaps == NULL) {
+    this->sinkcaps = gst_caps_copy (caps);
+    gst_structure_remove_field (gst_caps_get_structure (this->sinkcaps, 0),
+        "channel-mask");
+  }
+  GST_OBJECT_UNLOCK (this);
+
+  if (!ret) {
+    GST_WARNING_OBJECT (pad, "caps %" GST_PTR_FORMAT " differ from the "
+        "other streams", caps);
+    return FALSE;
+  }
+
+  gst_audio_aggregator_set_sink_caps (GST_AUDIO_AGGREGATOR (this),
+      GST_AUDIO_AGGREGATOR_PAD (pad), caps);
+
+  gst_pad_mark_reconfigure (GST_AGGREGATOR_SRC_PAD (this));
+  return TRUE;
+}
+
+static gboolean
+gst_loudnorm_mux_sink_event (GstAggregator * agg, GstAggregatorPad * pad,
+    GstEvent * event)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (agg);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+    GstCaps *caps;
+    gboolean ret;
+
+    gst_event_parse_caps (event, &caps);
+    ret = gst_loudnorm_mux_setcaps (this, pad, caps);
+    gst_event_unref (event);
+    return ret;
+  }
+
+  return GST_AGGREGATOR_CLASS (gst_loudnorm_mux_parent_class)->sink_event
+      (agg, pad, event);
+}
+
+static gboolean
+gst_loudnorm_mux_sink_query (GstAggregator * agg, GstAggregatorPad * pad,
+    GstQuery * query)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (agg);
+  GstCaps *caps;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:{
+      GstCaps *filter;
+
+      gst_query_parse_caps (query, &filter);
+
+      GST_OBJECT_LOCK (this);
+      caps = this->sinkcaps ? gst_caps_ref (this->sinkcaps) : NULL;
+      GST_OBJECT_UNLOCK (this);
+      if (caps == NULL)
+        caps = gst_pad_get_pad_template_caps (GST_PAD (pad));
+
+      if (filter) {
+        GstCaps *tmp = gst_caps_intersect_full (filter, caps,
+            GST_CAPS_INTERSECT_FIRST);
+
+        gst_caps_unref (caps);
+        caps = tmp;
+      }
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    }
+    case GST_QUERY_ACCEPT_CAPS:{
+      GstCaps *template_caps;
+      gboolean accept;
+
+      gst_query_parse_accept_caps (query, &caps);
+
+      template_caps = gst_pad_get_pad_template_caps (GST_PAD (pad));
+      GST_OBJECT_LOCK (this);
+      accept = gst_caps_is_subset (caps, this->sinkcaps ? this->sinkcaps :
+          template_caps);
+      GST_OBJECT_UNLOCK (this);
+      gst_caps_unref (template_caps);
+
+      gst_query_set_accept_caps_result (query, accept);
+      return TRUE;
+    }
+    default:
+      break;
+  }
+
+  return GST_AGGREGATOR_CLASS (gst_loudnorm_mux_parent_class)->sink_query
+      (agg, pad, query);
+}
+
+/* One unpositioned channel per sink pad */
+static GstFlowReturn
+gst_loudnorm_mux_update_src_caps (GstAggregator * agg, GstCaps * caps,
+    GstCaps ** ret)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (agg);
+
+  GST_OBJECT_LOCK (this);
+  if (this->sinkcaps == NULL || GST_ELEMENT (this)->numsinkpads == 0) {
+    GST_OBJECT_UNLOCK (this);
+    return GST_AGGREGATOR_FLOW_NEED_DATA;
+  }
+  *ret = gst_caps_copy (this->sinkcaps);
+  gst_caps_set_simple (*ret,
+      "channels", G_TYPE_INT, GST_ELEMENT (this)->numsinkpads,
+      "channel-mask", GST_TYPE_BITMASK, (guint64) 0, NULL);
+  GST_OBJECT_UNLOCK (this);
+
+  if (!gst_caps_can_intersect (*ret, caps)) {
+    GST_WARNING_OBJECT (this, "downstream does not accept %" GST_PTR_FORMAT,
+        *ret);
+    gst_caps_replace (ret, NULL);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  return GST_FLOW_OK;
+}
+
+/* Gives the first channels sink pads their output channel and a
+ * processor. Pads requested since then wait for the next negotiation. */
+static gboolean
+gst_loudnorm_mux_negotiated_src_caps (GstAggregator * agg, GstCaps * caps)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (agg);
+  LoudnormPoolKey key = { 0 };
+  GstAudioInfo info;
+  GPtrArray *pads;
+  gboolean ret = TRUE;
+
+  if (!GST_AGGREGATOR_CLASS (gst_loudnorm_mux_parent_class)->
+      negotiated_src_caps (agg, caps))
+    return FALSE;
+  if (!gst_audio_info_from_caps (&info, caps))
+    return FALSE;
+
+  key.format = gst_loudnorm_mux_processor_format (GST_AUDIO_INFO_FORMAT
+      (&info));
+  key.rate = GST_AUDIO_INFO_RATE (&info);
+  key.channels = 1;
+  key.factor = 1;
+
+  pads = g_ptr_array_new ();
+  GST_OBJECT_LOCK (this);
+  for (GList * l = GST_ELEMENT (this)->sinkpads; l; l = l->next) {
+    if (pads->len == (guint) GST_AUDIO_INFO_CHANNELS (&info))
+      break;
+    g_ptr_array_add (pads, gst_object_ref (l->data));
+  }
+  GST_OBJECT_UNLOCK (this);
+
+  g_mutex_lock (&this->streams_lock);
+  /* the processors stay with their pads unless the format changed */
+  gst_loudnorm_mux_clear_streams (this, key.format !=
+      this->processor_key.format || key.rate != this->processor_key.rate);
+  this->processor_key = key;
+  this->bps = GST_AUDIO_INFO_BPS (&info);
+
+  for (guint c = 0; c < pads->len; c++) {
+    GstLoudnormMuxPad *pad = g_ptr_array_index (pads, c);
+
+    if (pad->processor == NULL) {
+      pad->processor = loudnorm_pool_acquire (&key);
+      if (pad->processor == NULL) {
+        GST_ERROR_OBJECT (this, "Failed to allocate the loudness meter");
+        ret = FALSE;
+        break;
+      }
+      /* a new stream starts at its targets, with every other setting as
+       * a loudnorm element has it by default */
+      loudnorm_processor_set_defaults (pad->processor);
+      loudnorm_processor_set_silence_threshold (pad->processor,
+          DEFAULT_SILENCE_THRESHOLD);
+      loudnorm_processor_set_times (pad->processor, DEFAULT_ATTACK_TIME,
+          DEFAULT_RELEASE_TIME);
+      pad->params_seen = g_atomic_int_get (&pad->params_serial);
+      GST_OBJECT_LOCK (pad);
+      loudnorm_processor_set_target (pad->processor, pad->target_loudness,
+          pad->target_lra);
+      GST_OBJECT_UNLOCK (pad);
+    }
+    pad->channel = c;
+    g_ptr_array_add (this->streams, gst_object_ref (pad));
+  }
+  g_mutex_unlock (&this->streams_lock);
+
+  GST_DEBUG_OBJECT (this, "normalizing %u streams", pads->len);
+
+  g_ptr_array_foreach (pads, (GFunc) gst_object_unref, NULL);
+  g_ptr_array_free (pads, TRUE);
+
+  return ret;
+}
+
+static GstPad *
+gst_loudnorm_mux_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstPad *pad = GST_ELEMENT_CLASS (gst_loudnorm_mux_parent_class)->
+      request_new_pad (element, templ, name, caps);
+
+  if (pad == NULL)
+    return NULL;
+
+  gst_pad_mark_reconfigure (GST_AGGREGATOR_SRC_PAD (element));
+  gst_child_proxy_child_added (GST_CHILD_PROXY (element), G_OBJECT (pad),
+      GST_OBJECT_NAME (pad));
+
+  return pad;
+}
+
+static void
+gst_loudnorm_mux_release_pad (GstElement * element, GstPad * pad)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (element);
+  GstLoudnormMuxPad *mpad = GST_LOUDNORM_MUX_PAD (pad);
+
+  /* its channel is silent until the next negotiation drops it */
+  g_mutex_lock (&this->streams_lock);
+  if (mpad->channel < this->streams->len) {
+    g_ptr_array_index (this->streams, mpad->channel) = NULL;
+    mpad->channel = G_MAXUINT;
+    gst_object_unref (mpad);
+  }
+  loudnorm_pool_release (&this->processor_key, mpad->processor);
+  mpad->processor = NULL;
+  g_mutex_unlock (&this->streams_lock);
+
+  GST_OBJECT_LOCK (this);
+  if (element->numsinkpads == 1)
+    gst_caps_replace (&this->sinkcaps, NULL);
+  GST_OBJECT_UNLOCK (this);
+
+  gst_pad_mark_reconfigure (GST_AGGREGATOR_SRC_PAD (element));
+  gst_child_proxy_child_removed (GST_CHILD_PROXY (element), G_OBJECT (pad),
+      GST_OBJECT_NAME (pad));
+
+  GST_ELEMENT_CLASS (gst_loudnorm_mux_parent_class)->release_pad (element,
+      pad);
+}
+
+static gboolean
+gst_loudnorm_mux_start (GstAggregator * agg)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (agg);
+  GError *error = NULL;
+  guint threads = this->threads > 0 ? this->threads : g_get_num_processors ();
+
+  if (GST_AGGREGATOR_CLASS (gst_loudnorm_mux_parent_class)->start &&
+      !GST_AGGREGATOR_CLASS (gst_loudnorm_mux_parent_class)->start (agg))
+    return FALSE;
+
+  if (threads < 2)
+    return TRUE;
+
+  this->pool = g_thread_pool_new (gst_loudnorm_mux_worker, this,
+      threads - 1, FALSE, &error);
+  if (this->pool == NULL) {
+    GST_ERROR_OBJECT (this, "Failed to create the worker threads: %s",
+        error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (this, "normalizing on %u threads", threads);
+
+  return TRUE;
+}
+
+static gboolean
+gst_loudnorm_mux_stop (GstAggregator * agg)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (agg);
+
+  if (this->pool) {
+    g_thread_pool_free (this->pool, FALSE, TRUE);
+    this->pool = NULL;
+  }
+
+  g_mutex_lock (&this->streams_lock);
+  gst_loudnorm_mux_clear_streams (this, TRUE);
+  g_mutex_unlock (&this->streams_lock);
+
+  GST_OBJECT_LOCK (this);
+  gst_caps_replace (&this->sinkcaps, NULL);
+  GST_OBJECT_UNLOCK (this);
+
+  if (GST_AGGREGATOR_CLASS (gst_loudnorm_mux_parent_class)->stop)
+    return GST_AGGREGATOR_CLASS (gst_loudnorm_mux_parent_class)->stop (agg);
+  return TRUE;
+}
+
+static void
+gst_loudnorm_mux_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (object);
+
+  switch (property_id) {
+    case PROP_THREADS:
+      this->threads = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_loudnorm_mux_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (object);
+
+  switch (property_id) {
+    case PROP_THREADS:
+      g_value_set_uint (value, this->threads);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_loudnorm_mux_finalize (GObject * object)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (object);
+
+  gst_loudnorm_mux_clear_streams (this, TRUE);
+  g_ptr_array_free (this->streams, TRUE);
+  gst_caps_replace (&this->sinkcaps, NULL);
+  g_mutex_clear (&this->streams_lock);
+  g_mutex_clear (&this->batch_lock);
+  g_cond_clear (&this->batch_cond);
+
+  G_OBJECT_CLASS (gst_loudnorm_mux_parent_class)->finalize (object);
+}
+
+/* GstChildProxy, the sink pads in the order they were requested */
+
+static GObject *
+gst_loudnorm_mux_child_proxy_get_child_by_index (GstChildProxy * proxy,
+    guint index)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (proxy);
+  GObject *obj;
+
+  GST_OBJECT_LOCK (this);
+  obj = g_list_nth_data (GST_ELEMENT (this)->sinkpads, index);
+  if (obj)
+    gst_object_ref (obj);
+  GST_OBJECT_UNLOCK (this);
+
+  return obj;
+}
+
+static guint
+gst_loudnorm_mux_child_proxy_get_children_count (GstChildProxy * proxy)
+{
+  GstLoudnormMux *this = GST_LOUDNORM_MUX (proxy);
+  guint count;
+
+  GST_OBJECT_LOCK (this);
+  count = GST_ELEMENT (this)->numsinkpads;
+  GST_OBJECT_UNLOCK (this);
+
+  return count;
+}
+
+static void
+gst_loudnorm_mux_child_proxy_init (gpointer g_iface, gpointer iface_data)
+{
+  GstChildProxyInterface *iface = g_iface;
+
+  iface->get_child_by_index = gst_loudnorm_mux_child_proxy_get_child_by_index;
+  iface->get_children_count = gst_loudnorm_mux_child_proxy_get_children_count;
+}
+
+static void
+gst_loudnorm_mux_class_init (GstLoudnormMuxClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstAggregatorClass *aggregator_class = GST_AGGREGATOR_CLASS (klass);
+  GstAudioAggregatorClass *audio_aggregator_class =
+      GST_AUDIO_AGGREGATOR_CLASS (klass);
+
+  gst_element_class_add_static_pad_template_with_gtype (element_class,
+      &gst_loudnorm_mux_src_template, GST_TYPE_AGGREGATOR_PAD);
+  gst_element_class_add_static_pad_template_with_gtype (element_class,
+      &gst_loudnorm_mux_sink_template, GST_TYPE_LOUDNORM_MUX_PAD);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Loudness Normalization Mux", "Filter/Audio",
+      "Normalizes the loudness of many mono streams into one interleaved "
+      "stream", "Sivaram <sivaram@cradlewise.com>");
+
+  gobject_class->set_property = gst_loudnorm_mux_set_property;
+  gobject_class->get_property = gst_loudnorm_mux_get_property;
+  gobject_class->finalize = gst_loudnorm_mux_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Threads normalizing batches of streams in parallel "
+          "(0 = one per core, applied on start)", 0, 256, 0,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_mux_request_new_pad);
+  element_class->release_pad = GST_DEBUG_FUNCPTR (gst_loudnorm_mux_release_pad);
+
+  aggregator_class->start = GST_DEBUG_FUNCPTR (gst_loudnorm_mux_start);
+  aggregator_class->stop = GST_DEBUG_FUNCPTR (gst_loudnorm_mux_stop);
+  aggregator_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_mux_sink_event);
+  aggregator_class->sink_query =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_mux_sink_query);
+  aggregator_class->update_src_caps =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_mux_update_src_caps);
+  aggregator_class->negotiated_src_caps =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_mux_negotiated_src_caps);
+  aggregator_class->finish_buffer =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_mux_finish_buffer);
+
+  audio_aggregator_class->aggregate_one_buffer =
+      GST_DEBUG_FUNCPTR (gst_loudnorm_mux_aggregate_one_buffer);
+}
+
+static void
+gst_loudnorm_mux_init (GstLoudnormMux * this)
+{
+  this->streams = g_ptr_array_new ();
+  g_mutex_init (&this->streams_lock);
+  g_mutex_init (&this->batch_lock);
+  g_cond_init (&this->batch_cond);
+}
@@ -0,0 +1,104 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_LOUDNORM_MUX_H_
+#define _GST_LOUDNORM_MUX_H_
+
+#include <gst/audio/gstaudioaggregator.h>
+#include "loudnormpool.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_LOUDNORM_MUX   (gst_loudnorm_mux_get_type())
+#define GST_LOUDNORM_MUX(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_LOUDNORM_MUX,GstLoudnormMux))
+#define GST_IS_LOUDNORM_MUX(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_LOUDNORM_MUX))
+
+#define GST_TYPE_LOUDNORM_MUX_PAD   (gst_loudnorm_mux_pad_get_type())
+#define GST_LOUDNORM_MUX_PAD(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_LOUDNORM_MUX_PAD,GstLoudnormMuxPad))
+#define GST_IS_LOUDNORM_MUX_PAD(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_LOUDNORM_MUX_PAD))
+
+typedef struct _GstLoudnormMux GstLoudnormMux;
+typedef struct _GstLoudnormMuxClass GstLoudnormMuxClass;
+typedef struct _GstLoudnormMuxPad GstLoudnormMuxPad;
+typedef struct _GstLoudnormMuxPadClass GstLoudnormMuxPadClass;
+
+/* One mono stream, normalized on its own and written to output channel
+ * channel */
+struct _GstLoudnormMuxPad
+{
+  GstAudioAggregatorPad parent;
+
+  /* targets, under the object lock. set_property bumps params_serial,
+   * the batch picks the new values up when it sees that. */
+  float target_loudness;
+  float target_lra;
+  gint params_serial;
+
+  /* owned by the aggregate thread and the batch running the stream,
+   * under the streams_lock of the mux */
+  LoudnormProcessor *processor;
+  gint params_seen;
+  guint channel;
+};
+
+struct _GstLoudnormMuxPadClass
+{
+  GstAudioAggregatorPadClass parent_class;
+};
+
+struct _GstLoudnormMux
+{
+  GstAudioAggregator parent;
+
+  /* caps all sink pads share, under the object lock */
+  GstCaps *sinkcaps;
+
+  /* Pads in output channel order, NULL where a pad went away since the
+   * last negotiation. Their samples are gathered into planes, one row of
+   * plane_frames per stream, and normalized there in place. */
+  GMutex streams_lock;
+  GPtrArray *streams;
+  LoudnormPoolKey processor_key;
+  guint bps;
+  guint8 *planes;
+  gsize plane_frames;
+
+  /* the streams are cut into one batch per thread, the aggregate thread
+   * runs the first itself and the pool the others while it waits for
+   * batch_pending */
+  guint threads;
+  GThreadPool *pool;
+  guint batch_streams;
+  gsize batch_frames;
+  gint batch_pending;
+  GMutex batch_lock;
+  GCond batch_cond;
+};
+
+struct _GstLoudnormMuxClass
+{
+  GstAudioAggregatorClass parent_class;
+};
+
+GType gst_loudnorm_mux_get_type (void);
+GType gst_loudnorm_mux_pad_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,158 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * Persistent cache of per-stream loudness analysis.
+ *
+ * Every stream gets one file in the cache directory, named after the SHA1
+ * of its key (the stream-id or a user supplied key). The file is a fixed
+ * little-endian header followed by the optional float timeline, so a
+ * lookup is a single mmap and a few field reads.
+ */
+
+#include "loudnormcache.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define CACHE_MAGIC "LNC1"
+#define CACHE_VERSION 1
+#define CACHE_SUFFIX ".lnc"
+
+typedef struct {
+  gchar magic[4];
+  guint32 version;
+  guint32 rate;
+  guint32 channels;
+  gdouble integrated;
+  gdouble range;
+  gdouble peak;
+  guint32 timeline_len;
+  guint32 reserved;
+} CacheHeader;
+
+G_STATIC_ASSERT (sizeof (CacheHeader) == 48);
+G_STATIC_ASSERT (G_BYTE_ORDER == G_LITTLE_ENDIAN);
+
+static gchar *
+cache_path (const gchar * dir, const gchar * key)
+{
+  gchar *hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+  gchar *name = g_strconcat (hash, CACHE_SUFFIX, NULL);
+  gchar *path = g_build_filename (dir, name, NULL);
+
+  g_free (name);
+  g_free (hash);
+  return path;
+}
+
+LoudnormCacheEntry *
+loudnorm_cache_lookup (const gchar * dir, const gchar * key)
+{
+  LoudnormCacheEntry *entry;
+  const CacheHeader *header;
+  GMappedFile *file;
+  gchar *path;
+  gsize len;
+
+  g_return_val_if_fail (dir != NULL && key != NULL, NULL);
+
+  path = cache_path (dir, key);
+  file = g_mapped_file_new (path, FALSE, NULL);
+  g_free (path);
+
+  if (file == NULL)
+    return NULL;
+
+  header = (const CacheHeader *) g_mapped_file_get_contents (file);
+  len = g_mapped_file_get_length (file);
+
+  if (len < sizeof (CacheHeader) ||
+      memcmp (header->magic, CACHE_MAGIC, 4) != 0 ||
+      header->version != CACHE_VERSION ||
+      len < sizeof (CacheHeader) +
+      (gsize) header->timeline_len * sizeof (float)) {
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  entry = g_new0 (LoudnormCacheEntry, 1);
+  entry->integrated = header->integrated;
+  entry->range = header->range;
+  entry->peak = header->peak;
+  entry->rate = header->rate;
+  entry->channels = header->channels;
+  entry->timeline_len = header->timeline_len;
+  if (entry->timeline_len > 0)
+    entry->timeline = (const float *) (header + 1);
+  entry->file = file;
+
+  return entry;
+}
+
+void
+loudnorm_cache_entry_free (LoudnormCacheEntry * entry)
+{
+  if (entry == NULL)
+    return;
+
+  if (entry->file)
+    g_mapped_file_unref (entry->file);
+  g_free (entry);
+}
+
+gboolean
+loudnorm_cache_store (const gchar * dir, const gchar * key,
+    const LoudnormCacheEntry * entry, GError ** error)
+{
+  gsize timeline_size = (gsize) entry->timeline_len * sizeof (float);
+  gsize size = sizeof (CacheHeader) + timeline_size;
+  CacheHeader *header;
+  gchar *path;
+  gboolean ret;
+
+  g_return_val_if_fail (dir != NULL && key != NULL, FALSE);
+
+  if (g_mkdir_with_parents (dir, 0755) != 0) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Could not create cache directory %s", dir);
+    return FALSE;
+  }
+
+  header = g_malloc0 (size);
+  memcpy (header->magic, CACHE_MAGIC, 4);
+  header->version = CACHE_VERSION;
+  header->rate = entry->rate;
+  header->channels = entry->channels;
+  header->integrated = entry->integrated;
+  header->range = entry->range;
+  header->peak = entry->peak;
+  header->timeline_len = entry->timeline_len;
+  if (timeline_size > 0)
+    memcpy (header + 1, entry->timeline, timeline_size);
+
+  /* written to a temporary file and renamed, readers never see a torn
+   * entry */
+  path = cache_path (dir, key);
+  ret = g_file_set_contents (path, (const gchar *) header, size, error);
+  g_free (path);
+  g_free (header);
+
+  return ret;
+}
@@ -0,0 +1,53 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_CACHE_H_
+#define _LOUDNORM_CACHE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Interval of the optional loudness timeline */
+#define LOUDNORM_CACHE_TIMELINE_INTERVAL_MS 100
+
+/* Analysis results of one stream. The timeline points into the mapped
+ * cache file and stays valid until the entry is freed. */
+typedef struct {
+  double integrated;            /* LUFS */
+  double range;                 /* LU */
+  double peak;                  /* linear sample peak */
+  guint rate;
+  guint channels;
+  const float *timeline;        /* momentary LUFS every 100 ms, or NULL */
+  guint timeline_len;
+
+  GMappedFile *file;
+} LoudnormCacheEntry;
+
+LoudnormCacheEntry *loudnorm_cache_lookup (const gchar * dir,
+    const gchar * key);
+void loudnorm_cache_entry_free (LoudnormCacheEntry * entry);
+
+gboolean loudnorm_cache_store (const gchar * dir, const gchar * key,
+    const LoudnormCacheEntry * entry, GError ** error);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,340 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * Gain stage for the loudnorm element.
+ *
+ * The linear gain is turned once per call into a 15 bit mantissa and a
+ * right shift, gain ~= mult / 2^shift, so every sample costs one 16x16->32
+ * multiply, a shift and a saturating narrow. The mantissa keeps the error
+ * of the applied gain below 2^-15 relative, which keeps the output within
+ * 1 LSB of the double precision multiply and clamp it replaces.
+ *
+ * S32 and F32 are plain loops the compiler vectorizes; S32 needs the
+ * extra precision of a double multiply so there is no fixed-point trick.
+ */
+
+#include "loudnormgain.h"
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LOUDNORM_GAIN_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define LOUDNORM_GAIN_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef size_t (*GainS16Func) (const int16_t * src, int16_t * dst, size_t n,
+    int16_t mult, int shift);
+
+typedef struct {
+  const char *name;
+  GainS16Func s16;
+} GainImpl;
+
+static const GainImpl *gain_impl = NULL;
+
+/* Splits gain into mult / 2^shift with mult in [16384, 32767] */
+static void
+quantize_gain (double gain, int16_t * mult, int *shift)
+{
+  int exp;
+  double mant;
+  long q;
+
+  /* zero, negative and NaN gains all silence the output */
+  if (!(gain > 0.0)) {
+    *mult = 0;
+    *shift = 0;
+    return;
+  }
+
+  /* anything above this saturates every non-zero sample anyway */
+  if (gain > 32767.0)
+    gain = 32767.0;
+
+  mant = frexp (gain, &exp);
+  q = lrint (mant * 32768.0);
+  if (q == 32768) {
+    q = 16384;
+    exp++;
+  }
+
+  *shift = 15 - exp;
+  *mult = (int16_t) q;
+
+  /* below 2^-15 every product truncates to zero */
+  if (*shift > 30) {
+    *mult = 0;
+    *shift = 0;
+  }
+}
+
+static size_t
+gain_s16_scalar (const int16_t * src, int16_t * dst, size_t n, int16_t mult,
+    int shift)
+{
+  int32_t bias = (int32_t) ((1u << shift) - 1);
+  size_t clipped = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    int32_t p = (int32_t) src[i] * mult;
+
+    // round towards zero, (short) cast semantics
+    p = (p + ((p >> 31) & bias)) >> shift;
+
+    if (p > 32767) {
+      dst[i] = 32767;
+      clipped++;
+    } else if (p < -32768) {
+      dst[i] = -32768;
+      clipped++;
+    } else {
+      dst[i] = (int16_t) p;
+    }
+  }
+
+  return clipped;
+}
+
+#ifdef LOUDNORM_GAIN_X86
+__attribute__ ((target ("sse2")))
+static size_t
+gain_s16_sse2 (const int16_t * src, int16_t * dst, size_t n, int16_t mult,
+    int shift)
+{
+  const __m128i m = _mm_set1_epi16 (mult);
+  const __m128i bias = _mm_set1_epi32 ((int32_t) ((1u << shift) - 1));
+  const __m128i count = _mm_cvtsi32_si128 (shift);
+  const __m128i hi_limit = _mm_set1_epi32 (32767);
+  const __m128i lo_limit = _mm_set1_epi32 (-32768);
+  __m128i clipped = _mm_setzero_si128 ();
+  int32_t lanes[4];
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128 ((const __m128i *) (src + i));
+    __m128i lo = _mm_mullo_epi16 (x, m);
+    __m128i hi = _mm_mulhi_epi16 (x, m);
+    __m128i p0 = _mm_unpacklo_epi16 (lo, hi);
+    __m128i p1 = _mm_unpackhi_epi16 (lo, hi);
+
+    p0 = _mm_add_epi32 (p0, _mm_and_si128 (_mm_srai_epi32 (p0, 31), bias));
+    p1 = _mm_add_epi32 (p1, _mm_and_si128 (_mm_srai_epi32 (p1, 31), bias));
+    p0 = _mm_sra_epi32 (p0, count);
+    p1 = _mm_sra_epi32 (p1, count);
+
+    /* compare masks are -1, subtracting them counts the clipped lanes */
+    clipped = _mm_sub_epi32 (clipped, _mm_cmpgt_epi32 (p0, hi_limit));
+    clipped = _mm_sub_epi32 (clipped, _mm_cmplt_epi32 (p0, lo_limit));
+    clipped = _mm_sub_epi32 (clipped, _mm_cmpgt_epi32 (p1, hi_limit));
+    clipped = _mm_sub_epi32 (clipped, _mm_cmplt_epi32 (p1, lo_limit));
+
+    _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packs_epi32 (p0, p1));
+  }
+
+  _mm_storeu_si128 ((__m128i *) lanes, clipped);
+
+  return (size_t) lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+      gain_s16_scalar (src + i, dst + i, n - i, mult, shift);
+}
+
+__attribute__ ((target ("avx2")))
+static size_t
+gain_s16_avx2 (const int16_t * src, int16_t * dst, size_t n, int16_t mult,
+    int shift)
+{
+  const __m256i m = _mm256_set1_epi16 (mult);
+  const __m256i bias = _mm256_set1_epi32 ((int32_t) ((1u << shift) - 1));
+  const __m128i count = _mm_cvtsi32_si128 (shift);
+  const __m256i hi_limit = _mm256_set1_epi32 (32767);
+  const __m256i lo_limit = _mm256_set1_epi32 (-32768);
+  __m256i clipped = _mm256_setzero_si256 ();
+  int32_t lanes[8];
+  size_t total = 0, i = 0;
+
+  /* unpack and packs both work per 128 bit lane, so the sample order
+   * survives the round trip through 32 bits */
+  for (; i + 16 <= n; i += 16) {
+    __m256i x = _mm256_loadu_si256 ((const __m256i *) (src + i));
+    __m256i lo = _mm256_mullo_epi16 (x, m);
+    __m256i hi = _mm256_mulhi_epi16 (x, m);
+    __m256i p0 = _mm256_unpacklo_epi16 (lo, hi);
+    __m256i p1 = _mm256_unpackhi_epi16 (lo, hi);
+
+    p0 = _mm256_add_epi32 (p0,
+        _mm256_and_si256 (_mm256_srai_epi32 (p0, 31), bias));
+    p1 = _mm256_add_epi32 (p1,
+        _mm256_and_si256 (_mm256_srai_epi32 (p1, 31), bias));
+    p0 = _mm256_sra_epi32 (p0, count);
+    p1 = _mm256_sra_epi32 (p1, count);
+
+    clipped = _mm256_sub_epi32 (clipped, _mm256_cmpgt_epi32 (p0, hi_limit));
+    clipped = _mm256_sub_epi32 (clipped, _mm256_cmpgt_epi32 (lo_limit, p0));
+    clipped = _mm256_sub_epi32 (clipped, _mm256_cmpgt_epi32 (p1, hi_limit));
+    clipped = _mm256_sub_epi32 (clipped, _mm256_cmpgt_epi32 (lo_limit, p1));
+
+    _mm256_storeu_si256 ((__m256i *) (dst + i), _mm256_packs_epi32 (p0, p1));
+  }
+
+  _mm256_storeu_si256 ((__m256i *) lanes, clipped);
+  for (int l = 0; l < 8; l++)
+    total += lanes[l];
+
+  return total + gain_s16_sse2 (src + i, dst + i, n - i, mult, shift);
+}
+#endif
+
+#ifdef LOUDNORM_GAIN_NEON
+static size_t
+gain_s16_neon (const int16_t * src, int16_t * dst, size_t n, int16_t mult,
+    int shift)
+{
+  const int32x4_t bias = vdupq_n_s32 ((int32_t) ((1u << shift) - 1));
+  const int32x4_t count = vdupq_n_s32 (-shift);
+  const int32x4_t hi_limit = vdupq_n_s32 (32767);
+  const int32x4_t lo_limit = vdupq_n_s32 (-32768);
+  uint32x4_t clipped = vdupq_n_u32 (0);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t x = vld1q_s16 (src + i);
+    int32x4_t p0 = vmull_n_s16 (vget_low_s16 (x), mult);
+    int32x4_t p1 = vmull_high_n_s16 (x, mult);
+
+    p0 = vaddq_s32 (p0, vandq_s32 (vshrq_n_s32 (p0, 31), bias));
+    p1 = vaddq_s32 (p1, vandq_s32 (vshrq_n_s32 (p1, 31), bias));
+    p0 = vshlq_s32 (p0, count);
+    p1 = vshlq_s32 (p1, count);
+
+    clipped = vsubq_u32 (clipped, vcgtq_s32 (p0, hi_limit));
+    clipped = vsubq_u32 (clipped, vcltq_s32 (p0, lo_limit));
+    clipped = vsubq_u32 (clipped, vcgtq_s32 (p1, hi_limit));
+    clipped = vsubq_u32 (clipped, vcltq_s32 (p1, lo_limit));
+
+    vst1q_s16 (dst + i, vcombine_s16 (vqmovn_s32 (p0), vqmovn_s32 (p1)));
+  }
+
+  return vaddvq_u32 (clipped) +
+      gain_s16_scalar (src + i, dst + i, n - i, mult, shift);
+}
+#endif
+
+static const GainImpl gain_impl_scalar = { "scalar", gain_s16_scalar };
+#ifdef LOUDNORM_GAIN_X86
+static const GainImpl gain_impl_sse2 = { "sse2", gain_s16_sse2 };
+static const GainImpl gain_impl_avx2 = { "avx2", gain_s16_avx2 };
+#endif
+#ifdef LOUDNORM_GAIN_NEON
+static const GainImpl gain_impl_neon = { "neon", gain_s16_neon };
+#endif
+
+void
+loudnorm_gain_init (void)
+{
+  const GainImpl *impl = &gain_impl_scalar;
+
+#ifdef LOUDNORM_GAIN_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    impl = &gain_impl_avx2;
+  else if (__builtin_cpu_supports ("sse2"))
+    impl = &gain_impl_sse2;
+#endif
+#ifdef LOUDNORM_GAIN_NEON
+  // NEON is mandatory on arm64
+  impl = &gain_impl_neon;
+#endif
+
+  /* every caller picks the same kernel, so racing here is harmless */
+  __atomic_store_n (&gain_impl, impl, __ATOMIC_RELEASE);
+}
+
+static const GainImpl *
+get_impl (void)
+{
+  const GainImpl *impl = __atomic_load_n (&gain_impl, __ATOMIC_ACQUIRE);
+
+  if (impl == NULL) {
+    loudnorm_gain_init ();
+    impl = __atomic_load_n (&gain_impl, __ATOMIC_ACQUIRE);
+  }
+  return impl;
+}
+
+const char *
+loudnorm_gain_get_impl_name (void)
+{
+  return get_impl ()->name;
+}
+
+size_t
+loudnorm_gain_apply_s16 (const int16_t * src, int16_t * dst, size_t n,
+    double gain)
+{
+  int16_t mult;
+  int shift;
+
+  quantize_gain (gain, &mult, &shift);
+  return get_impl ()->s16 (src, dst, n, mult, shift);
+}
+
+size_t
+loudnorm_gain_apply_s32 (const int32_t * src, int32_t * dst, size_t n,
+    double gain)
+{
+  size_t clipped = 0;
+
+  if (!(gain > 0.0))
+    gain = 0.0;
+
+  for (size_t i = 0; i < n; i++) {
+    double v = src[i] * gain;
+
+    if (v > 2147483647.0) {
+      dst[i] = INT32_MAX;
+      clipped++;
+    } else if (v < -2147483648.0) {
+      dst[i] = INT32_MIN;
+      clipped++;
+    } else {
+      dst[i] = (int32_t) v;
+    }
+  }
+
+  return clipped;
+}
+
+size_t
+loudnorm_gain_apply_f32 (const float *src, float *dst, size_t n, double gain)
+{
+  const float g = (float) gain;
+  size_t clipped = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    dst[i] = src[i] * g;
+    clipped += fabsf (dst[i]) > 1.0f;
+  }
+
+  return clipped;
+}
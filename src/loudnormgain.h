@@ -0,0 +1,57 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_GAIN_H_
+#define _LOUDNORM_GAIN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Picks the fastest gain kernel for the running CPU. Safe to call more
+ * than once; loudnorm_gain_apply_s16 calls it lazily if needed. */
+void loudnorm_gain_init (void);
+
+/* Name of the selected kernel ("scalar", "sse2", "avx2" or "neon"). */
+const char *loudnorm_gain_get_impl_name (void);
+
+/* Multiplies n samples from src by the linear gain and writes them to dst,
+ * saturating to the int16 range and truncating towards zero like a
+ * (short) cast does. src and dst may be the same buffer. Returns the
+ * number of samples that had to be clipped. */
+size_t loudnorm_gain_apply_s16 (const int16_t * src, int16_t * dst, size_t n,
+    double gain);
+
+/* Same for 32 bit integer samples. */
+size_t loudnorm_gain_apply_s32 (const int32_t * src, int32_t * dst, size_t n,
+    double gain);
+
+/* Float samples are scaled without clamping, like the rest of the float
+ * pipeline they may exceed [-1.0, 1.0]; those are counted as clipped. */
+size_t loudnorm_gain_apply_f32 (const float *src, float *dst, size_t n,
+    double gain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,294 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * Lookahead limiter. With a delay of D frames, the output at frame n is
+ * the input of frame n - D, scaled by the gain g[n]:
+ *
+ *  - the frame peaks of the last D + 1 frames go through a monotonic
+ *    deque, whose front is their maximum, in O(1) per frame
+ *  - r[n] = min (1, ceiling / maximum) is the gain that keeps all of
+ *    those frames below the ceiling
+ *  - env[n] follows r down at once and back up with the release time
+ *  - g[n] is the mean of env over the last D + 1 frames
+ *
+ * Every env[j] averaged into g[n] has frame n - D in its window, so g[n]
+ * never exceeds r[n - D] and the output never exceeds the ceiling. The
+ * mean turns each dip into a ramp over the lookahead. The peaks and the
+ * scaling work on blocks of frames, only the deque and the envelope run
+ * frame by frame.
+ */
+
+#include "loudnormlimiter.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* how fast the gain recovers after a peak */
+#define LIMITER_RELEASE_MS 50.0
+
+/* frames per block */
+#define LIMITER_BLOCK 64
+
+struct _LoudnormLimiter
+{
+  unsigned int channels;
+  unsigned int delay;
+  float ceiling;
+  double release;
+
+  /* delay line, delay frames */
+  float *ring;
+  unsigned int ring_pos;
+
+  /* deque of frame peaks, window + 1 slots */
+  unsigned int window;
+  float *deque_peak;
+  uint64_t *deque_frame;
+  unsigned int deque_head;
+  unsigned int deque_len;
+  uint64_t frame;
+
+  /* release envelope and its running mean over window frames */
+  double env;
+  float *box;
+  unsigned int box_pos;
+  double box_sum;
+
+  float *scratch;
+  float peaks[LIMITER_BLOCK];
+  float gains[LIMITER_BLOCK];
+};
+
+LoudnormLimiter *
+loudnorm_limiter_new (unsigned int rate, unsigned int channels,
+    double lookahead_ms, double ceiling_db)
+{
+  LoudnormLimiter *limiter;
+  unsigned int delay;
+
+  if (rate == 0 || channels == 0)
+    return NULL;
+
+  delay = (unsigned int) lrint (lookahead_ms * rate / 1000.0);
+  if (delay < 1)
+    delay = 1;
+
+  limiter = calloc (1, sizeof (LoudnormLimiter));
+  if (limiter == NULL)
+    return NULL;
+
+  limiter->channels = channels;
+  limiter->delay = delay;
+  limiter->window = delay + 1;
+  limiter->ceiling = pow (10, ceiling_db / 20.0);
+  limiter->release = 1.0 - exp (-1000.0 / (LIMITER_RELEASE_MS * rate));
+
+  limiter->ring = malloc ((size_t) delay * channels * sizeof (float));
+  limiter->deque_peak = malloc ((limiter->window + 1) * sizeof (float));
+  limiter->deque_frame = malloc ((limiter->window + 1) * sizeof (uint64_t));
+  limiter->box = malloc (limiter->window * sizeof (float));
+  limiter->scratch = malloc ((size_t) LIMITER_BLOCK * channels *
+      sizeof (float));
+  if (limiter->ring == NULL || limiter->deque_peak == NULL ||
+      limiter->deque_frame == NULL || limiter->box == NULL ||
+      limiter->scratch == NULL) {
+    loudnorm_limiter_free (limiter);
+    return NULL;
+  }
+
+  loudnorm_limiter_reset (limiter);
+
+  return limiter;
+}
+
+void
+loudnorm_limiter_free (LoudnormLimiter * limiter)
+{
+  if (limiter == NULL)
+    return;
+
+  free (limiter->ring);
+  free (limiter->deque_peak);
+  free (limiter->deque_frame);
+  free (limiter->box);
+  free (limiter->scratch);
+  free (limiter);
+}
+
+void
+loudnorm_limiter_reset (LoudnormLimiter * limiter)
+{
+  memset (limiter->ring, 0,
+      (size_t) limiter->delay * limiter->channels * sizeof (float));
+  limiter->ring_pos = 0;
+
+  limiter->deque_head = 0;
+  limiter->deque_len = 0;
+  limiter->frame = 0;
+
+  limiter->env = 1.0;
+  for (unsigned int i = 0; i < limiter->window; i++)
+    limiter->box[i] = 1.0f;
+  limiter->box_pos = 0;
+  limiter->box_sum = limiter->window;
+}
+
+unsigned int
+loudnorm_limiter_get_delay (const LoudnormLimiter * limiter)
+{
+  return limiter->delay;
+}
+
+/* Largest absolute sample of each of n frames */
+static void
+loudnorm_limiter_peaks (const LoudnormLimiter * limiter, const float *data,
+    size_t n, float *peaks)
+{
+  unsigned int channels = limiter->channels;
+
+  for (size_t f = 0; f < n; f++) {
+    float peak = 0.0f;
+
+    for (unsigned int c = 0; c < channels; c++) {
+      float v = fabsf (data[f * channels + c]);
+
+      peak = v > peak ? v : peak;
+    }
+    peaks[f] = peak;
+  }
+}
+
+/* Runs n frame peaks through the deque and the envelope */
+static void
+loudnorm_limiter_gains (LoudnormLimiter * limiter, const float *peaks,
+    size_t n, float *gains)
+{
+  unsigned int slots = limiter->window + 1;
+
+  for (size_t f = 0; f < n; f++) {
+    uint64_t frame = limiter->frame++;
+    float peak = peaks[f];
+    unsigned int tail = limiter->deque_head + limiter->deque_len;
+    double r;
+
+    if (tail >= slots)
+      tail -= slots;
+
+    /* drop the smaller peaks behind the new one, and the front once it
+     * left the window */
+    while (limiter->deque_len > 0) {
+      unsigned int last = tail == 0 ? slots - 1 : tail - 1;
+
+      if (limiter->deque_peak[last] > peak)
+        break;
+      tail = last;
+      limiter->deque_len--;
+    }
+    limiter->deque_peak[tail] = peak;
+    limiter->deque_frame[tail] = frame;
+    limiter->deque_len++;
+
+    if (frame - limiter->deque_frame[limiter->deque_head] >=
+        limiter->window) {
+      if (++limiter->deque_head == slots)
+        limiter->deque_head = 0;
+      limiter->deque_len--;
+    }
+
+    peak = limiter->deque_peak[limiter->deque_head];
+    r = peak > limiter->ceiling ? limiter->ceiling / peak : 1.0;
+
+    if (r < limiter->env)
+      limiter->env = r;
+    else
+      limiter->env += (r - limiter->env) * limiter->release;
+
+    limiter->box_sum += limiter->env - limiter->box[limiter->box_pos];
+    limiter->box[limiter->box_pos] = limiter->env;
+    if (++limiter->box_pos == limiter->window) {
+      /* resum once per turn, so rounding errors don't pile up */
+      double sum = 0.0;
+
+      for (unsigned int i = 0; i < limiter->window; i++)
+        sum += limiter->box[i];
+      limiter->box_sum = sum;
+      limiter->box_pos = 0;
+    }
+
+    gains[f] = limiter->box_sum / limiter->window;
+  }
+}
+
+void
+loudnorm_limiter_process (LoudnormLimiter * limiter, float *data,
+    size_t frames)
+{
+  unsigned int channels = limiter->channels;
+  size_t block = limiter->delay < LIMITER_BLOCK ?
+      limiter->delay : LIMITER_BLOCK;
+
+  while (frames > 0) {
+    size_t n = frames < block ? frames : block;
+    size_t len = n * channels;
+    size_t first = limiter->delay - limiter->ring_pos;
+    float *ring = limiter->ring + (size_t) limiter->ring_pos * channels;
+
+    if (first > n)
+      first = n;
+
+    loudnorm_limiter_peaks (limiter, data, n, limiter->peaks);
+    loudnorm_limiter_gains (limiter, limiter->peaks, n, limiter->gains);
+
+    /* swap the block with the oldest frames of the delay line, which
+     * wraps at most once as blocks are not longer than the delay */
+    memcpy (limiter->scratch, data, len * sizeof (float));
+    memcpy (data, ring, first * channels * sizeof (float));
+    memcpy (ring, limiter->scratch, first * channels * sizeof (float));
+    if (first < n) {
+      memcpy (data + first * channels, limiter->ring,
+          (n - first) * channels * sizeof (float));
+      memcpy (limiter->ring, limiter->scratch + first * channels,
+          (n - first) * channels * sizeof (float));
+    }
+    limiter->ring_pos = (limiter->ring_pos + n) % limiter->delay;
+
+    for (size_t f = 0; f < n; f++) {
+      float gain = limiter->gains[f];
+
+      for (unsigned int c = 0; c < channels; c++)
+        data[f * channels + c] *= gain;
+    }
+
+    data += len;
+    frames -= n;
+  }
+}
+
+size_t
+loudnorm_limiter_get_footprint (const LoudnormLimiter * limiter)
+{
+  return sizeof (LoudnormLimiter) +
+      (size_t) limiter->delay * limiter->channels * sizeof (float) +
+      (limiter->window + 1) * (sizeof (float) + sizeof (uint64_t)) +
+      limiter->window * sizeof (float) +
+      (size_t) LIMITER_BLOCK * limiter->channels * sizeof (float);
+}
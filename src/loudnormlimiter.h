@@ -0,0 +1,59 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_LIMITER_H_
+#define _LOUDNORM_LIMITER_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Lookahead peak limiter on interleaved float frames, 1.0 being full
+ * scale. The output is delayed by the lookahead and its samples stay
+ * within the ceiling, the gain dips in a ramp that starts a lookahead
+ * ahead of each peak instead of flattening it. */
+typedef struct _LoudnormLimiter LoudnormLimiter;
+
+/* lookahead_ms is rounded to whole frames, at least one. Returns NULL on
+ * failure. */
+LoudnormLimiter *loudnorm_limiter_new (unsigned int rate,
+    unsigned int channels, double lookahead_ms, double ceiling_db);
+void loudnorm_limiter_free (LoudnormLimiter * limiter);
+
+/* Fills the delay with silence and lets the gain go back to unity */
+void loudnorm_limiter_reset (LoudnormLimiter * limiter);
+
+/* Delay of the output in frames */
+unsigned int loudnorm_limiter_get_delay (const LoudnormLimiter * limiter);
+
+/* Limits frames in place: data gets the frames from the delay line
+ * with the gain applied, the delay line takes data */
+void loudnorm_limiter_process (LoudnormLimiter * limiter, float *data,
+    size_t frames);
+
+/* Bytes held by the limiter */
+size_t loudnorm_limiter_get_footprint (const LoudnormLimiter * limiter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1065 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * K-weighting and block energies follow libebur128 1.2: the same shelf
+ * and RLB highpass, 100 ms blocks of (rate + 5) / 10 frames, and channel
+ * energies summed with their BS.1770 weights. Instead of keeping the
+ * filtered samples around, every block is reduced to the energies of its
+ * ten 10 ms slices, and the momentary and short-term windows are running
+ * sums over the last 40 and 300 slices.
+ *
+ * libebur128 windows are sample exact. Here the slice that is still being
+ * filled is added as is and the oldest slice of the window is scaled down
+ * by how far the current one has progressed. That is exact for stationary
+ * signals and otherwise off by at most part of one 10 ms slice, which
+ * only shows right at the edges of silence.
+ *
+ * The filter runs in single precision with one channel per SIMD lane: 4
+ * lanes (SSE on x86, NEON on arm64, whatever the compiler has elsewhere)
+ * or 8 lanes with AVX when there are more than 4 channels. The two
+ * biquads are kept separate in direct form I, which holds up in float
+ * where libebur128's combined 4th order section would not.
+ *
+ * With gating enabled, every 400 ms block (each 100 ms) goes into a
+ * histogram of 0.1 LU bins from -70 to +30 LUFS for integrated loudness,
+ * and every 3 s short-term block (each second) into a second one for the
+ * loudness range, like libebur128 in EBUR128_MODE_HISTOGRAM. The bins
+ * also sum the block energies, so only blocks sharing a bin with the
+ * relative gate are gated approximately.
+ *
+ * Wide streams can be split into shards of whole lane groups, each a
+ * meter of its own that filters its channels out of the same interleaved
+ * frames on a caller provided thread and only reports slice energies.
+ * The slices of all shards end on the same frames, so adding their
+ * weighted energies up gives exactly what one meter would have measured.
+ */
+
+#include "loudnormmeter.h"
+#include "loudnormrange.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLICES_PER_BLOCK 10
+#define SLICES_MOMENTARY (4 * SLICES_PER_BLOCK)
+#define SLICES_SHORTTERM (30 * SLICES_PER_BLOCK)
+
+_Static_assert (SLICES_SHORTTERM == LOUDNORM_METER_SLICES,
+    "the saved window is the short-term window");
+
+#define HISTOGRAM_BINS 1000
+#define HISTOGRAM_MIN -70.0
+#define HISTOGRAM_STEP 0.1
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LOUDNORM_METER_X86 1
+#endif
+
+/* x[n-1], x[n-2], shelf and highpass outputs likewise, then the peak */
+#define STATE_VECTORS 7
+
+/* frames converted at a time */
+#define METER_CHUNK 512
+
+/* slices a shard reports per run, the input is split to fit */
+#define SHARD_SLICES 100
+
+typedef float v4sf __attribute__ ((vector_size (16)));
+typedef int32_t v4si __attribute__ ((vector_size (16)));
+typedef float v8sf __attribute__ ((vector_size (32)));
+typedef int32_t v8si __attribute__ ((vector_size (32)));
+
+typedef struct
+{
+  uint64_t count[HISTOGRAM_BINS];
+  double energy[HISTOGRAM_BINS];
+} Histogram;
+
+typedef void (*DeinterleaveFunc) (LoudnormMeter * meter, const void *data,
+    size_t frames, size_t step);
+
+typedef struct
+{
+  void (*filter) (LoudnormMeter * meter, size_t offset, size_t frames);
+  unsigned int lanes;
+  const char *name;
+} FilterImpl;
+
+struct _LoudnormMeter
+{
+  unsigned int rate;
+  unsigned int channels;
+  /* channels of the interleaved frames and the first one measured */
+  unsigned int stride;
+  unsigned int first_channel;
+  size_t block_frames;
+  const FilterImpl *impl;
+
+  /* shelf and highpass coefficients, the highpass numerator is 1 -2 1 */
+  float shelf_b[3];
+  float shelf_a[2];
+  float hp_a[2];
+
+  /* STATE_VECTORS per group of lanes */
+  float *state;
+  unsigned int groups;
+
+  double *weights;
+
+  /* lane ordered frames for the filter, METER_CHUNK per group */
+  float *scratch;
+
+  /* only every factor-th frame is measured, skip frames precede the next */
+  unsigned int factor;
+  size_t skip;
+
+  /* largest absolute sample since the last loudnorm_meter_take_peak */
+  float peak;
+
+  /* weighted energy of the slice being filled */
+  double current;
+  size_t current_frames;
+  size_t slice_frames;
+  unsigned int slice;
+
+  /* ring of completed slice energies and the window sums over it */
+  double slices[SLICES_SHORTTERM];
+  unsigned int head;
+  double sum_momentary;
+  double sum_shortterm;
+
+  /* completed 100 ms blocks and the gating histograms */
+  uint64_t blocks;
+  Histogram *gating;
+  Histogram *range;
+
+  /* loudness range of the recent short-term values */
+  LoudnormRange *window;
+
+  /* meters of the channel shards and who runs them */
+  LoudnormMeter **shards;
+  unsigned int n_shards;
+  LoudnormMeterRunner runner;
+  void *runner_data;
+
+  /* a shard collects its completed slice energies here */
+  double *out;
+  size_t out_len;
+};
+
+typedef struct
+{
+  LoudnormMeter *meter;
+  DeinterleaveFunc deinterleave;
+  const uint8_t *data;
+  size_t frames;
+  size_t bpf;
+} ShardJob;
+
+/* Slices split a block as evenly as the frame count allows */
+static size_t
+loudnorm_meter_slice_frames (const LoudnormMeter * meter, unsigned int slice)
+{
+  return (slice + 1) * meter->block_frames / SLICES_PER_BLOCK -
+      slice * meter->block_frames / SLICES_PER_BLOCK;
+}
+
+static void
+loudnorm_meter_init_filter (LoudnormMeter * meter, unsigned int rate)
+{
+  double f0 = 1681.974450955533;
+  double G = 3.999843853973347;
+  double Q = 0.7071752369554196;
+
+  double K = tan (M_PI * f0 / (double) rate);
+  double Vh = pow (10.0, G / 20.0);
+  double Vb = pow (Vh, 0.4996667741545416);
+  double a0 = 1.0 + K / Q + K * K;
+
+  /* high shelf */
+  meter->shelf_b[0] = (Vh + Vb * K / Q + K * K) / a0;
+  meter->shelf_b[1] = 2.0 * (K * K - Vh) / a0;
+  meter->shelf_b[2] = (Vh - Vb * K / Q + K * K) / a0;
+  meter->shelf_a[0] = 2.0 * (K * K - 1.0) / a0;
+  meter->shelf_a[1] = (1.0 - K / Q + K * K) / a0;
+
+  /* RLB highpass */
+  f0 = 38.13547087602444;
+  Q = 0.5003270373238773;
+  K = tan (M_PI * f0 / (double) rate);
+  a0 = 1.0 + K / Q + K * K;
+
+  meter->hp_a[0] = 2.0 * (K * K - 1.0) / a0;
+  meter->hp_a[1] = (1.0 - K / Q + K * K) / a0;
+}
+
+/* Converts every step-th interleaved frame to floats in lane order, one
+ * run per group of lanes in the scratch buffer. Unused lanes of the
+ * last group are zero. Building the vectors while filtering instead
+ * stalls on store forwarding. */
+#define DEINTERLEAVE(type, scale, L)                                         \
+  for (unsigned int g = 0; g < meter->groups; g++) {                         \
+    unsigned int c0 = g * L;                                                 \
+    unsigned int lanes = channels - c0 < L ? channels - c0 : L;              \
+    float *out = meter->scratch + (size_t) g * METER_CHUNK * L;              \
+                                                                             \
+    if (lanes < L)                                                           \
+      memset (out, 0, frames * L * sizeof (float));                          \
+    for (size_t i = 0; i < frames; i++) {                                    \
+      const type *frame = in + i * step * stride + c0;                       \
+                                                                             \
+      for (unsigned int l = 0; l < lanes; l++)                               \
+        out[i * L + l] = frame[l] * (scale);                                 \
+    }                                                                        \
+  }
+
+#define DEFINE_DEINTERLEAVE(name, type, scale)                               \
+static void                                                                  \
+name (LoudnormMeter * meter, const void *data, size_t frames, size_t step)   \
+{                                                                            \
+  const type *in = data;                                                     \
+  const unsigned int channels = meter->channels;                             \
+  const size_t stride = meter->stride;                                       \
+                                                                             \
+  /* a constant lane count lets the compiler unroll the inner loop */       \
+  if (meter->impl->lanes == 8) {                                             \
+    DEINTERLEAVE (type, scale, 8)                                            \
+  } else {                                                                   \
+    DEINTERLEAVE (type, scale, 4)                                            \
+  }                                                                          \
+}
+
+DEFINE_DEINTERLEAVE (deinterleave_s16, int16_t, 1.0f / 32768.0f)
+DEFINE_DEINTERLEAVE (deinterleave_s32, int32_t, 1.0f / 2147483648.0f)
+DEFINE_DEINTERLEAVE (deinterleave_f32, float, 1.0f)
+
+/* Filters frames of every channel group starting at offset in the
+ * scratch buffer, adds the weighted sum of squares to the current slice
+ * and updates the peaks. frames never crosses a slice, so flushing
+ * denormals here keeps silence from decaying into them. */
+#define FLUSH(V, VI, v) \
+    ((V) ((VI) (v) & ((V) ((VI) (v) & abs_mask) >= FLT_MIN)))
+
+#define DEFINE_FILTER(name, V, VI, L, attr)                                  \
+attr static void                                                             \
+name (LoudnormMeter * meter, size_t offset, size_t frames)                   \
+{                                                                            \
+  const unsigned int channels = meter->channels;                             \
+  const float b0 = meter->shelf_b[0], b1 = meter->shelf_b[1];                \
+  const float b2 = meter->shelf_b[2];                                        \
+  const float a1 = meter->shelf_a[0], a2 = meter->shelf_a[1];                \
+  const float h1 = meter->hp_a[0], h2 = meter->hp_a[1];                      \
+  const VI abs_mask = (VI) { 0 } + 0x7fffffff;                               \
+                                                                             \
+  for (unsigned int g = 0; g < meter->groups; g++) {                         \
+    unsigned int c0 = g * L;                                                 \
+    unsigned int lanes = channels - c0 < L ? channels - c0 : L;              \
+    const float *in = meter->scratch + (g * METER_CHUNK + offset) * L;       \
+    float *st = meter->state + (size_t) g * STATE_VECTORS * L;               \
+    V x1, x2, y1, y2, z1, z2, total, peak = { 0 }, sum = { 0 };              \
+    float sums[L], peaks[L];                                                 \
+                                                                             \
+    memcpy (&x1, st, sizeof (V));                                            \
+    memcpy (&x2, st + L, sizeof (V));                                        \
+    memcpy (&y1, st + 2 * L, sizeof (V));                                    \
+    memcpy (&y2, st + 3 * L, sizeof (V));                                    \
+    memcpy (&z1, st + 4 * L, sizeof (V));                                    \
+    memcpy (&z2, st + 5 * L, sizeof (V));                                    \
+                                                                             \
+    for (size_t i = 0; i < frames; i++) {                                    \
+      V x, y, z, ax;                                                         \
+                                                                             \
+      memcpy (&x, in + i * L, sizeof (V));                                   \
+                                                                             \
+      /* the feedback of the previous output comes last, which keeps     \
+       * the dependency chain between frames to a multiply and a sub */      \
+      y = b0 * x + b1 * x1 + b2 * x2 - a2 * y2 - a1 * y1;                    \
+      z = y - 2.0f * y1 + y2 - h2 * z2 - h1 * z1;                            \
+      x2 = x1;                                                               \
+      x1 = x;                                                                \
+      y2 = y1;                                                               \
+      y1 = y;                                                                \
+      z2 = z1;                                                               \
+      z1 = z;                                                                \
+                                                                             \
+      sum += z * z;                                                          \
+      ax = (V) ((VI) x & abs_mask);                                          \
+      peak = (V) (((VI) ax & (ax > peak)) | ((VI) peak & (ax <= peak)));     \
+    }                                                                        \
+                                                                             \
+    y1 = FLUSH (V, VI, y1);                                                  \
+    y2 = FLUSH (V, VI, y2);                                                  \
+    z1 = FLUSH (V, VI, z1);                                                  \
+    z2 = FLUSH (V, VI, z2);                                                  \
+                                                                             \
+    memcpy (st, &x1, sizeof (V));                                            \
+    memcpy (st + L, &x2, sizeof (V));                                        \
+    memcpy (st + 2 * L, &y1, sizeof (V));                                    \
+    memcpy (st + 3 * L, &y2, sizeof (V));                                    \
+    memcpy (st + 4 * L, &z1, sizeof (V));                                    \
+    memcpy (st + 5 * L, &z2, sizeof (V));                                    \
+                                                                             \
+    /* the peaks since the last reset, and those since the last take */      \
+    memcpy (&total, st + 6 * L, sizeof (V));                                 \
+    total = (V) (((VI) peak & (peak > total)) |                              \
+        ((VI) total & (peak <= total)));                                     \
+    memcpy (st + 6 * L, &total, sizeof (V));                                 \
+                                                                             \
+    memcpy (sums, &sum, sizeof (V));                                         \
+    memcpy (peaks, &peak, sizeof (V));                                       \
+    for (unsigned int l = 0; l < lanes; l++) {                               \
+      meter->current += meter->weights[c0 + l] * sums[l];                    \
+      meter->peak = peaks[l] > meter->peak ? peaks[l] : meter->peak;         \
+    }                                                                        \
+  }                                                                          \
+}
+
+DEFINE_FILTER (filter_x4, v4sf, v4si, 4, )
+
+static const FilterImpl filter_impl_x4 = {
+  filter_x4, 4,
+#if defined(LOUDNORM_METER_X86)
+  "sse"
+#elif defined(__aarch64__)
+  "neon"
+#else
+  "generic"
+#endif
+};
+
+#ifdef LOUDNORM_METER_X86
+#define AVX __attribute__ ((target ("avx")))
+DEFINE_FILTER (filter_x8, v8sf, v8si, 8, AVX)
+#undef AVX
+
+static const FilterImpl filter_impl_x8 = {
+  filter_x8, 8, "avx"
+};
+#endif
+
+static const FilterImpl *
+loudnorm_meter_pick_impl (unsigned int channels)
+{
+#ifdef LOUDNORM_METER_X86
+  if (channels > 4 && __builtin_cpu_supports ("avx"))
+    return &filter_impl_x8;
+#endif
+  return &filter_impl_x4;
+}
+
+LoudnormMeter *
+loudnorm_meter_new (unsigned int rate, unsigned int channels)
+{
+  return loudnorm_meter_new_decimated (rate, channels, 1);
+}
+
+LoudnormMeter *
+loudnorm_meter_new_decimated (unsigned int rate, unsigned int channels,
+    unsigned int factor)
+{
+  LoudnormMeter *meter;
+  size_t lanes;
+
+  /* lower rates put the shelf above Nyquist, and far below that the
+   * 100 ms blocks get too short to slice */
+  if (channels == 0 || factor == 0 || rate / factor < LOUDNORM_METER_MIN_RATE)
+    return NULL;
+
+  meter = calloc (1, sizeof (LoudnormMeter));
+  if (meter == NULL)
+    return NULL;
+
+  meter->rate = rate;
+  meter->channels = channels;
+  meter->stride = channels;
+  meter->factor = factor;
+  meter->block_frames = (rate / factor + 5) / 10;
+  meter->impl = loudnorm_meter_pick_impl (channels);
+  meter->groups = (channels + meter->impl->lanes - 1) / meter->impl->lanes;
+  lanes = (size_t) meter->groups * meter->impl->lanes;
+  meter->state = calloc (lanes * STATE_VECTORS, sizeof (float));
+  meter->weights = malloc ((size_t) channels * sizeof (double));
+  meter->scratch = malloc (METER_CHUNK * lanes * sizeof (float));
+  if (meter->state == NULL || meter->weights == NULL ||
+      meter->scratch == NULL)
+    goto error;
+
+  for (unsigned int c = 0; c < channels; c++)
+    meter->weights[c] = 1.0;
+
+  loudnorm_meter_init_filter (meter, rate / factor);
+  meter->slice_frames = loudnorm_meter_slice_frames (meter, 0);
+
+  return meter;
+
+error:
+  loudnorm_meter_free (meter);
+  return NULL;
+}
+
+void
+loudnorm_meter_free (LoudnormMeter * meter)
+{
+  if (meter == NULL)
+    return;
+
+  for (unsigned int s = 0; s < meter->n_shards; s++)
+    loudnorm_meter_free (meter->shards[s]);
+  free (meter->shards);
+  free (meter->out);
+  free (meter->state);
+  free (meter->weights);
+  free (meter->scratch);
+  free (meter->gating);
+  free (meter->range);
+  loudnorm_range_free (meter->window);
+  free (meter);
+}
+
+void
+loudnorm_meter_reset (LoudnormMeter * meter)
+{
+  size_t lanes = (size_t) meter->groups * meter->impl->lanes;
+
+  memset (meter->state, 0, lanes * STATE_VECTORS * sizeof (float));
+  meter->skip = 0;
+  meter->peak = 0.0f;
+  memset (meter->slices, 0, sizeof (meter->slices));
+  meter->current = 0.0;
+  meter->current_frames = 0;
+  meter->slice = 0;
+  meter->slice_frames = loudnorm_meter_slice_frames (meter, 0);
+  meter->head = 0;
+  meter->sum_momentary = 0.0;
+  meter->sum_shortterm = 0.0;
+  meter->blocks = 0;
+  if (meter->gating)
+    memset (meter->gating, 0, sizeof (Histogram));
+  if (meter->range)
+    memset (meter->range, 0, sizeof (Histogram));
+  if (meter->window)
+    loudnorm_range_reset (meter->window);
+
+  for (unsigned int s = 0; s < meter->n_shards; s++)
+    loudnorm_meter_reset (meter->shards[s]);
+}
+
+int
+loudnorm_meter_enable_gating (LoudnormMeter * meter)
+{
+  if (meter->gating == NULL)
+    meter->gating = calloc (1, sizeof (Histogram));
+  if (meter->range == NULL)
+    meter->range = calloc (1, sizeof (Histogram));
+
+  return meter->gating != NULL && meter->range != NULL;
+}
+
+int
+loudnorm_meter_enable_range_window (LoudnormMeter * meter,
+    unsigned int seconds)
+{
+  loudnorm_range_free (meter->window);
+  meter->window = loudnorm_range_new (seconds * 10);
+
+  return meter->window != NULL;
+}
+
+unsigned int
+loudnorm_meter_set_shards (LoudnormMeter * meter, unsigned int shards,
+    LoudnormMeterRunner runner, void *user_data)
+{
+  unsigned int per, count;
+
+  if (meter->n_shards > 0 || meter->out)
+    return meter->n_shards;
+
+  /* every shard gets whole groups of 4 lanes */
+  per = shards > 1 ? (meter->channels + shards - 1) / shards : meter->channels;
+  per = (per + 3) / 4 * 4;
+  if (runner == NULL || per >= meter->channels)
+    return 1;
+  count = (meter->channels + per - 1) / per;
+
+  meter->shards = calloc (count, sizeof (LoudnormMeter *));
+  if (meter->shards == NULL)
+    return 0;
+
+  for (unsigned int s = 0; s < count; s++) {
+    unsigned int first = s * per;
+    unsigned int channels = meter->channels - first < per ?
+        meter->channels - first : per;
+    LoudnormMeter *shard = loudnorm_meter_new_decimated (meter->rate,
+        channels, meter->factor);
+
+    meter->shards[s] = shard;
+    if (shard == NULL)
+      goto error;
+
+    shard->stride = meter->channels;
+    shard->first_channel = first;
+    memcpy (shard->weights, meter->weights + first,
+        channels * sizeof (double));
+    shard->out = malloc ((SHARD_SLICES + 2) * sizeof (double));
+    if (shard->out == NULL)
+      goto error;
+  }
+
+  meter->n_shards = count;
+  meter->runner = runner;
+  meter->runner_data = user_data;
+
+  return count;
+
+error:
+  for (unsigned int s = 0; s < count; s++)
+    loudnorm_meter_free (meter->shards[s]);
+  free (meter->shards);
+  meter->shards = NULL;
+  return 0;
+}
+
+unsigned int
+loudnorm_meter_get_shards (const LoudnormMeter * meter)
+{
+  return meter->n_shards > 0 ? meter->n_shards : 1;
+}
+
+const char *
+loudnorm_meter_get_impl_name (const LoudnormMeter * meter)
+{
+  return meter->impl->name;
+}
+
+void
+loudnorm_meter_set_channel_weight (LoudnormMeter * meter,
+    unsigned int channel, double weight)
+{
+  if (channel >= meter->channels)
+    return;
+
+  meter->weights[channel] = weight;
+  for (unsigned int s = 0; s < meter->n_shards; s++) {
+    LoudnormMeter *shard = meter->shards[s];
+
+    if (channel - shard->first_channel < shard->channels)
+      shard->weights[channel - shard->first_channel] = weight;
+  }
+}
+
+static double
+energy_to_loudness (double energy)
+{
+  return 10.0 * log10 (energy) - 0.691;
+}
+
+/* Blocks below the -70 LUFS absolute gate are dropped */
+static void
+histogram_add (Histogram * histogram, double energy)
+{
+  double loudness;
+  int bin;
+
+  if (energy <= 0.0)
+    return;
+
+  loudness = energy_to_loudness (energy);
+  if (loudness < HISTOGRAM_MIN)
+    return;
+
+  bin = (int) ((loudness - HISTOGRAM_MIN) / HISTOGRAM_STEP);
+  if (bin >= HISTOGRAM_BINS)
+    bin = HISTOGRAM_BINS - 1;
+
+  histogram->count[bin]++;
+  histogram->energy[bin] += energy;
+}
+
+/* First bin whose blocks pass a relative gate at gate times the mean */
+static int
+histogram_gate (const Histogram * histogram, double gate)
+{
+  double energy = 0.0, threshold;
+  uint64_t count = 0;
+  int bin;
+
+  for (int i = 0; i < HISTOGRAM_BINS; i++) {
+    count += histogram->count[i];
+    energy += histogram->energy[i];
+  }
+
+  if (count == 0)
+    return -1;
+
+  threshold = energy_to_loudness (energy / count * gate);
+  if (threshold < HISTOGRAM_MIN)
+    return 0;
+
+  bin = (int) ((threshold - HISTOGRAM_MIN) / HISTOGRAM_STEP);
+  return bin < HISTOGRAM_BINS ? bin : HISTOGRAM_BINS - 1;
+}
+
+/* Called at every 100 ms block boundary, where the window sums are exact */
+static void
+loudnorm_meter_push_block (LoudnormMeter * meter)
+{
+  meter->blocks++;
+
+  /* EBU Tech 3342 asks for short-term values at 10 Hz or more */
+  if (meter->window && meter->blocks >= 30)
+    loudnorm_range_push (meter->window,
+        energy_to_loudness (meter->sum_shortterm /
+            (30.0 * meter->block_frames)));
+
+  if (meter->gating == NULL)
+    return;
+
+  if (meter->blocks >= 4)
+    histogram_add (meter->gating, meter->sum_momentary /
+        (4.0 * meter->block_frames));
+
+  if (meter->blocks >= 30 && (meter->blocks - 30) % 10 == 0)
+    histogram_add (meter->range, meter->sum_shortterm /
+        (30.0 * meter->block_frames));
+}
+
+static void
+loudnorm_meter_push_slice (LoudnormMeter * meter)
+{
+  unsigned int head = meter->head;
+  double energy = meter->current;
+
+  if (meter->out)
+    meter->out[meter->out_len++] = energy;
+
+  meter->sum_momentary += energy -
+      meter->slices[(head + SLICES_SHORTTERM - SLICES_MOMENTARY) %
+      SLICES_SHORTTERM];
+  meter->sum_shortterm += energy - meter->slices[head];
+  meter->slices[head] = energy;
+  meter->head = head = (head + 1) % SLICES_SHORTTERM;
+
+  /* recompute the sums once per lap so rounding can't accumulate */
+  if (head == 0) {
+    meter->sum_momentary = 0.0;
+    meter->sum_shortterm = 0.0;
+    for (unsigned int i = 0; i < SLICES_SHORTTERM; i++) {
+      meter->sum_shortterm += meter->slices[i];
+      if (i >= SLICES_SHORTTERM - SLICES_MOMENTARY)
+        meter->sum_momentary += meter->slices[i];
+    }
+  }
+
+  meter->current = 0.0;
+  meter->current_frames = 0;
+  meter->slice = (meter->slice + 1) % SLICES_PER_BLOCK;
+  meter->slice_frames = loudnorm_meter_slice_frames (meter, meter->slice);
+
+  if (meter->slice == 0)
+    loudnorm_meter_push_block (meter);
+}
+
+/* Filters the converted frames, split at slice boundaries. Silence
+ * only moves the slices on. */
+static void
+loudnorm_meter_process (LoudnormMeter * meter, size_t frames, int silence)
+{
+  size_t offset = 0;
+
+  while (frames > 0) {
+    size_t n = meter->slice_frames - meter->current_frames;
+
+    if (n > frames)
+      n = frames;
+
+    if (!silence)
+      meter->impl->filter (meter, offset, n);
+
+    meter->current_frames += n;
+    offset += n;
+    frames -= n;
+
+    if (meter->current_frames == meter->slice_frames)
+      loudnorm_meter_push_slice (meter);
+  }
+}
+
+static void loudnorm_meter_add (LoudnormMeter * meter,
+    DeinterleaveFunc deinterleave, const uint8_t * data, size_t frames,
+    size_t bpf);
+
+static void
+loudnorm_meter_run_shard (void *job_data, unsigned int index)
+{
+  const ShardJob *job = job_data;
+  LoudnormMeter *shard = job->meter->shards[index];
+  const uint8_t *data = job->data;
+
+  if (data)
+    data += shard->first_channel * (job->bpf / shard->stride);
+  loudnorm_meter_add (shard, job->deinterleave, data, job->frames, job->bpf);
+}
+
+/* Runs the shards over the frames and pushes the summed slices. Silence
+ * is cheap enough to do right here. */
+static void
+loudnorm_meter_add_sharded (LoudnormMeter * meter,
+    DeinterleaveFunc deinterleave, const uint8_t * data, size_t frames,
+    size_t bpf)
+{
+  const size_t piece = SHARD_SLICES *
+      (meter->block_frames / SLICES_PER_BLOCK) * meter->factor;
+  LoudnormMeter *first = meter->shards[0];
+
+  while (frames > 0) {
+    ShardJob job = { meter, deinterleave, data, frames, bpf };
+
+    if (job.frames > piece)
+      job.frames = piece;
+
+    for (unsigned int s = 0; s < meter->n_shards; s++)
+      meter->shards[s]->out_len = 0;
+
+    if (deinterleave) {
+      meter->runner (loudnorm_meter_run_shard, &job, meter->n_shards,
+          meter->runner_data);
+    } else {
+      for (unsigned int s = 0; s < meter->n_shards; s++)
+        loudnorm_meter_run_shard (&job, s);
+    }
+
+    /* every shard completed the same slices */
+    for (size_t k = 0; k < first->out_len; k++) {
+      meter->current = 0.0;
+      for (unsigned int s = 0; s < meter->n_shards; s++)
+        meter->current += meter->shards[s]->out[k];
+      loudnorm_meter_push_slice (meter);
+    }
+
+    meter->current = 0.0;
+    for (unsigned int s = 0; s < meter->n_shards; s++)
+      meter->current += meter->shards[s]->current;
+    meter->current_frames = first->current_frames;
+    meter->skip = first->skip;
+
+    if (deinterleave)
+      data += job.frames * bpf;
+    frames -= job.frames;
+  }
+}
+
+/* Without deinterleave the frames are silence and data is not read */
+static void
+loudnorm_meter_add (LoudnormMeter * meter, DeinterleaveFunc deinterleave,
+    const uint8_t * data, size_t frames, size_t bpf)
+{
+  const size_t step = meter->factor;
+
+  if (meter->n_shards > 0) {
+    loudnorm_meter_add_sharded (meter, deinterleave, data, frames, bpf);
+    return;
+  }
+
+  while (frames > meter->skip) {
+    size_t n = (frames - meter->skip + step - 1) / step, used;
+
+    if (n > METER_CHUNK)
+      n = METER_CHUNK;
+
+    if (deinterleave)
+      deinterleave (meter, data + meter->skip * bpf, n, step);
+    loudnorm_meter_process (meter, n, deinterleave == NULL);
+
+    /* the next measured frame may be in the next buffer */
+    used = meter->skip + n * step;
+    if (used > frames) {
+      meter->skip = used - frames;
+      return;
+    }
+
+    meter->skip = 0;
+    if (deinterleave)
+      data += used * bpf;
+    frames -= used;
+  }
+
+  meter->skip -= frames;
+}
+
+void
+loudnorm_meter_add_s16 (LoudnormMeter * meter, const int16_t * data,
+    size_t frames)
+{
+  loudnorm_meter_add (meter, deinterleave_s16, (const uint8_t *) data,
+      frames, meter->channels * sizeof (int16_t));
+}
+
+void
+loudnorm_meter_add_s32 (LoudnormMeter * meter, const int32_t * data,
+    size_t frames)
+{
+  loudnorm_meter_add (meter, deinterleave_s32, (const uint8_t *) data,
+      frames, meter->channels * sizeof (int32_t));
+}
+
+void
+loudnorm_meter_add_f32 (LoudnormMeter * meter, const float *data,
+    size_t frames)
+{
+  loudnorm_meter_add (meter, deinterleave_f32, (const uint8_t *) data,
+      frames, meter->channels * sizeof (float));
+}
+
+void
+loudnorm_meter_add_silence (LoudnormMeter * meter, size_t frames)
+{
+  size_t lanes = meter->impl->lanes;
+
+  /* the filters have settled, only the peaks stay */
+  for (unsigned int g = 0; g < meter->groups; g++)
+    memset (meter->state + g * STATE_VECTORS * lanes, 0,
+        (STATE_VECTORS - 1) * lanes * sizeof (float));
+  for (unsigned int s = 0; s < meter->n_shards; s++) {
+    LoudnormMeter *shard = meter->shards[s];
+
+    lanes = shard->impl->lanes;
+    for (unsigned int g = 0; g < shard->groups; g++)
+      memset (shard->state + g * STATE_VECTORS * lanes, 0,
+          (STATE_VECTORS - 1) * lanes * sizeof (float));
+  }
+
+  loudnorm_meter_add (meter, NULL, NULL, frames, 0);
+}
+
+static double
+loudnorm_meter_window (const LoudnormMeter * meter, double sum,
+    unsigned int slices)
+{
+  double oldest = meter->slices[(meter->head + SLICES_SHORTTERM - slices) %
+      SLICES_SHORTTERM];
+  double progress = (double) meter->current_frames / meter->slice_frames;
+  double energy = (sum - oldest * progress + meter->current) /
+      ((double) slices / SLICES_PER_BLOCK * meter->block_frames);
+
+  if (energy <= 0.0)
+    return -HUGE_VAL;
+
+  return energy_to_loudness (energy);
+}
+
+double
+loudnorm_meter_momentary (const LoudnormMeter * meter)
+{
+  return loudnorm_meter_window (meter, meter->sum_momentary,
+      SLICES_MOMENTARY);
+}
+
+double
+loudnorm_meter_shortterm (const LoudnormMeter * meter)
+{
+  return loudnorm_meter_window (meter, meter->sum_shortterm,
+      SLICES_SHORTTERM);
+}
+
+/* Mean energy of the blocks passing the -10 LU relative gate */
+double
+loudnorm_meter_integrated (const LoudnormMeter * meter)
+{
+  const Histogram *histogram = meter->gating;
+  double energy = 0.0;
+  uint64_t count = 0;
+  int start;
+
+  if (histogram == NULL || (start = histogram_gate (histogram, 0.1)) < 0)
+    return -HUGE_VAL;
+
+  for (int i = start; i < HISTOGRAM_BINS; i++) {
+    count += histogram->count[i];
+    energy += histogram->energy[i];
+  }
+
+  if (count == 0)
+    return -HUGE_VAL;
+
+  return energy_to_loudness (energy / count);
+}
+
+/* Spread between the 10th and 95th percentile of the short-term blocks
+ * passing the -20 LU relative gate, taken at the bin centers */
+double
+loudnorm_meter_range (const LoudnormMeter * meter)
+{
+  const Histogram *histogram = meter->range;
+  uint64_t count = 0, seen = 0, low, high;
+  double low_loudness = 0.0;
+  int start;
+
+  if (histogram == NULL || (start = histogram_gate (histogram, 0.01)) < 0)
+    return 0.0;
+
+  for (int i = start; i < HISTOGRAM_BINS; i++)
+    count += histogram->count[i];
+
+  if (count == 0)
+    return 0.0;
+
+  low = (uint64_t) ((count - 1) * 0.1 + 0.5);
+  high = (uint64_t) ((count - 1) * 0.95 + 0.5);
+
+  for (int i = start; i < HISTOGRAM_BINS; i++) {
+    double center = HISTOGRAM_MIN + (i + 0.5) * HISTOGRAM_STEP;
+
+    if (seen <= low && low < seen + histogram->count[i])
+      low_loudness = center;
+    if (seen <= high && high < seen + histogram->count[i])
+      return center - low_loudness;
+    seen += histogram->count[i];
+  }
+
+  return 0.0;
+}
+
+double
+loudnorm_meter_window_range (const LoudnormMeter * meter, double *mean)
+{
+  if (meter->window == NULL) {
+    if (mean)
+      *mean = -HUGE_VAL;
+    return 0.0;
+  }
+
+  return loudnorm_range_get (meter->window, mean);
+}
+
+uint64_t
+loudnorm_meter_get_slices (const LoudnormMeter * meter, float *levels)
+{
+  double scale = (double) SLICES_PER_BLOCK / meter->block_frames;
+
+  /* head is the oldest slice */
+  for (unsigned int i = 0; i < SLICES_SHORTTERM; i++)
+    levels[i] = meter->slices[(meter->head + i) % SLICES_SHORTTERM] * scale;
+
+  return meter->blocks;
+}
+
+void
+loudnorm_meter_set_slices (LoudnormMeter * meter, const float *levels,
+    uint64_t blocks)
+{
+  double scale = (double) meter->block_frames / SLICES_PER_BLOCK;
+
+  meter->sum_momentary = 0.0;
+  meter->sum_shortterm = 0.0;
+  for (unsigned int i = 0; i < SLICES_SHORTTERM; i++) {
+    /* anything but a finite energy would stick in the running sums */
+    double energy = levels[i] > 0.0f && isfinite (levels[i]) ?
+        levels[i] * scale : 0.0;
+
+    meter->slices[i] = energy;
+    meter->sum_shortterm += energy;
+    if (i >= SLICES_SHORTTERM - SLICES_MOMENTARY)
+      meter->sum_momentary += energy;
+  }
+  meter->head = 0;
+  meter->blocks = blocks;
+}
+
+unsigned int
+loudnorm_meter_get_window (const LoudnormMeter * meter, float *values,
+    unsigned int n)
+{
+  if (meter->window == NULL)
+    return 0;
+
+  return loudnorm_range_get_values (meter->window, values, n);
+}
+
+void
+loudnorm_meter_set_window (LoudnormMeter * meter, const float *values,
+    unsigned int n)
+{
+  if (meter->window == NULL)
+    return;
+
+  for (unsigned int i = 0; i < n; i++)
+    loudnorm_range_push (meter->window, values[i]);
+}
+
+double
+loudnorm_meter_take_peak (LoudnormMeter * meter)
+{
+  double peak = meter->peak;
+
+  for (unsigned int s = 0; s < meter->n_shards; s++) {
+    double p = loudnorm_meter_take_peak (meter->shards[s]);
+
+    peak = p > peak ? p : peak;
+  }
+
+  meter->peak = 0.0f;
+  return peak;
+}
+
+double
+loudnorm_meter_sample_peak (const LoudnormMeter * meter,
+    unsigned int channel)
+{
+  unsigned int lanes = meter->impl->lanes;
+
+  if (channel >= meter->channels)
+    return 0.0;
+
+  for (unsigned int s = 0; s < meter->n_shards; s++) {
+    const LoudnormMeter *shard = meter->shards[s];
+
+    if (channel - shard->first_channel < shard->channels)
+      return loudnorm_meter_sample_peak (shard,
+          channel - shard->first_channel);
+  }
+
+  return meter->state[(size_t) (channel / lanes) * STATE_VECTORS * lanes +
+      (STATE_VECTORS - 1) * lanes + channel % lanes];
+}
+
+size_t
+loudnorm_meter_get_footprint (const LoudnormMeter * meter)
+{
+  size_t lanes = (size_t) meter->groups * meter->impl->lanes;
+  size_t footprint = sizeof (LoudnormMeter) +
+      (size_t) meter->channels * sizeof (double) +
+      lanes * STATE_VECTORS * sizeof (float) +
+      METER_CHUNK * lanes * sizeof (float);
+
+  if (meter->gating)
+    footprint += 2 * sizeof (Histogram);
+  if (meter->window)
+    footprint += loudnorm_range_get_footprint (meter->window);
+  if (meter->out)
+    footprint += (SHARD_SLICES + 2) * sizeof (double);
+
+  for (unsigned int s = 0; s < meter->n_shards; s++)
+    footprint += sizeof (LoudnormMeter *) +
+        loudnorm_meter_get_footprint (meter->shards[s]);
+
+  return footprint;
+}
@@ -0,0 +1,155 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_METER_H_
+#define _LOUDNORM_METER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tracks momentary (400 ms) and short-term (3 s) loudness like libebur128
+ * does, with the same K-weighting, but keeps running energy sums over
+ * 10 ms slices so both queries cost O(1) instead of a window rescan.
+ * Optionally gates integrated loudness and loudness range as well. */
+typedef struct _LoudnormMeter LoudnormMeter;
+
+/* Lowest rate the meter measures at: the K-weighting shelf at 1.5 kHz
+ * needs some room below Nyquist */
+#define LOUDNORM_METER_MIN_RATE 8000
+
+/* Returns NULL below LOUDNORM_METER_MIN_RATE */
+LoudnormMeter *loudnorm_meter_new (unsigned int rate, unsigned int channels);
+
+/* Measures only every factor-th frame. Returns NULL if that is below
+ * LOUDNORM_METER_MIN_RATE. There is no lowpass before: what lies above
+ * the reduced Nyquist frequency aliases but keeps its energy, so
+ * loudness stays close. Peaks between the measured frames are missed. */
+LoudnormMeter *loudnorm_meter_new_decimated (unsigned int rate,
+    unsigned int channels, unsigned int factor);
+void loudnorm_meter_free (LoudnormMeter * meter);
+void loudnorm_meter_reset (LoudnormMeter * meter);
+
+/* Also collects the histograms for loudnorm_meter_integrated and
+ * loudnorm_meter_range. Returns 0 if they could not be allocated. */
+int loudnorm_meter_enable_gating (LoudnormMeter * meter);
+
+/* Also keeps the loudness range of the short-term values of the last
+ * seconds, for loudnorm_meter_window_range. Returns 0 on failure. */
+int loudnorm_meter_enable_range_window (LoudnormMeter * meter,
+    unsigned int seconds);
+
+/* Runs job (job_data, i) for every i below n, e.g. on a pool of
+ * threads, and returns once all of them are done */
+typedef void (*LoudnormMeterJob) (void *job_data, unsigned int index);
+typedef void (*LoudnormMeterRunner) (LoudnormMeterJob job, void *job_data,
+    unsigned int n, void *user_data);
+
+/* Splits the channels into up to shards groups of whole 4 lane vectors
+ * that runner filters in parallel; results stay the same. Call before
+ * adding frames. Returns the number of shards, 1 if the channels do not
+ * split and 0 on allocation failure. */
+unsigned int loudnorm_meter_set_shards (LoudnormMeter * meter,
+    unsigned int shards, LoudnormMeterRunner runner, void *user_data);
+
+/* Number of shards, 1 if the meter is not split */
+unsigned int loudnorm_meter_get_shards (const LoudnormMeter * meter);
+
+/* Name of the filter kernel ("sse", "avx", "neon" or "generic") */
+const char *loudnorm_meter_get_impl_name (const LoudnormMeter * meter);
+
+/* BS.1770 weight of a channel: 1.0 by default, 1.41 for surround
+ * channels and 0.0 to leave a channel (e.g. LFE) out. */
+void loudnorm_meter_set_channel_weight (LoudnormMeter * meter,
+    unsigned int channel, double weight);
+
+/* Filter and accumulate interleaved frames */
+void loudnorm_meter_add_s16 (LoudnormMeter * meter, const int16_t * data,
+    size_t frames);
+void loudnorm_meter_add_s32 (LoudnormMeter * meter, const int32_t * data,
+    size_t frames);
+void loudnorm_meter_add_f32 (LoudnormMeter * meter, const float *data,
+    size_t frames);
+
+/* Accounts for frames of digital silence without filtering them, for
+ * input too quiet to matter */
+void loudnorm_meter_add_silence (LoudnormMeter * meter, size_t frames);
+
+/* Loudness in LUFS of the last 400 ms / 3 s, -HUGE_VAL for silence */
+double loudnorm_meter_momentary (const LoudnormMeter * meter);
+double loudnorm_meter_shortterm (const LoudnormMeter * meter);
+
+/* Gated loudness of everything measured since the last reset, in LUFS
+ * (-HUGE_VAL if nothing passed the gates) and LU. Need gating enabled. */
+double loudnorm_meter_integrated (const LoudnormMeter * meter);
+double loudnorm_meter_range (const LoudnormMeter * meter);
+
+/* Loudness range in LU of the recent window, 0.0 until anything passed
+ * the gates. mean gets the gated mean short-term loudness in the window,
+ * -HUGE_VAL if none. Needs the range window enabled. */
+double loudnorm_meter_window_range (const LoudnormMeter * meter,
+    double *mean);
+
+/* The short-term window is made of this many 10 ms slices */
+#define LOUDNORM_METER_SLICES 300
+
+/* Copies the mean square of each completed slice of the short-term
+ * window, oldest first, to levels and returns the number of 100 ms
+ * blocks measured so far. Levels are per frame, so they do not depend
+ * on the rate. */
+uint64_t loudnorm_meter_get_slices (const LoudnormMeter * meter,
+    float *levels);
+
+/* Fills the window of a reset meter with saved levels, as if blocks
+ * 100 ms blocks had been measured, so momentary and short-term loudness
+ * pick up where they were */
+void loudnorm_meter_set_slices (LoudnormMeter * meter, const float *levels,
+    uint64_t blocks);
+
+/* Copies up to n of the latest short-term values of the range window,
+ * oldest first, to values and returns how many, 0 without a window */
+unsigned int loudnorm_meter_get_window (const LoudnormMeter * meter,
+    float *values, unsigned int n);
+
+/* Pushes saved short-term values into the range window of a reset
+ * meter */
+void loudnorm_meter_set_window (LoudnormMeter * meter, const float *values,
+    unsigned int n);
+
+/* Largest absolute sample of a channel since the last reset, 1.0 being
+ * full scale */
+double loudnorm_meter_sample_peak (const LoudnormMeter * meter,
+    unsigned int channel);
+
+/* Largest absolute sample of any channel filtered since the last call or
+ * reset, 1.0 being full scale, and starts over. Frames skipped at a
+ * reduced rate or added as silence are not seen. */
+double loudnorm_meter_take_peak (LoudnormMeter * meter);
+
+/* Bytes held by the meter */
+size_t loudnorm_meter_get_footprint (const LoudnormMeter * meter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,128 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * Pool of idle realtime processors.
+ *
+ * Pipelines that create an element per stream and tear it down again
+ * would otherwise allocate and free the meter windows, the range
+ * window and its trees every time. Released processors get the settings
+ * of a new one back, are reset right away and kept in one list per key,
+ * so taking one out under the lock is a hash lookup and a pop. The pool
+ * holds at most POOL_MAX of them, a burst beyond that is freed as
+ * before.
+ */
+
+#include "loudnormpool.h"
+
+/* about 25 KB each for stereo */
+#define POOL_MAX 64
+
+G_LOCK_DEFINE_STATIC (pool);
+static GHashTable *pool_table;
+static guint pool_size;
+
+static guint
+pool_key_hash (gconstpointer data)
+{
+  const LoudnormPoolKey *key = data;
+
+  return ((key->rate * 31 + key->channels) * 31 + key->factor) * 31 +
+      key->format * 2 + (key->gating ? 1 : 0);
+}
+
+static gboolean
+pool_key_equal (gconstpointer a, gconstpointer b)
+{
+  const LoudnormPoolKey *ka = a, *kb = b;
+
+  return ka->format == kb->format && ka->rate == kb->rate &&
+      ka->channels == kb->channels && ka->factor == kb->factor &&
+      !ka->gating == !kb->gating;
+}
+
+LoudnormProcessor *
+loudnorm_pool_acquire (const LoudnormPoolKey * key)
+{
+  LoudnormProcessor *processor = NULL;
+  GQueue *queue;
+
+  G_LOCK (pool);
+  if (pool_table && (queue = g_hash_table_lookup (pool_table, key)) &&
+      (processor = g_queue_pop_head (queue)))
+    pool_size--;
+  G_UNLOCK (pool);
+
+  if (processor)
+    return processor;
+
+  processor = loudnorm_processor_new (key->format, key->rate, key->channels,
+      key->factor);
+  if (processor && key->gating &&
+      !loudnorm_meter_enable_gating (loudnorm_processor_get_meter
+          (processor))) {
+    loudnorm_processor_free (processor);
+    return NULL;
+  }
+
+  return processor;
+}
+
+void
+loudnorm_pool_release (const LoudnormPoolKey * key,
+    LoudnormProcessor * processor)
+{
+  GQueue *queue;
+
+  if (processor == NULL)
+    return;
+
+  /* shards run on the threads of the element that split the meter */
+  if (loudnorm_meter_get_shards (loudnorm_processor_get_meter (processor)) >
+      1) {
+    loudnorm_processor_free (processor);
+    return;
+  }
+
+  /* done outside the lock, it touches all of the windows. The next owner
+   * gets what a new processor would have, not the settings of this one. */
+  loudnorm_processor_set_defaults (processor);
+  loudnorm_processor_reset (processor);
+
+  G_LOCK (pool);
+  if (pool_size < POOL_MAX) {
+    /* there are only ever a few keys, their queues stay */
+    if (pool_table == NULL)
+      pool_table = g_hash_table_new (pool_key_hash, pool_key_equal);
+    queue = g_hash_table_lookup (pool_table, key);
+    if (queue == NULL) {
+      LoudnormPoolKey *copy = g_new (LoudnormPoolKey, 1);
+
+      *copy = *key;
+      queue = g_queue_new ();
+      g_hash_table_insert (pool_table, copy, queue);
+    }
+    g_queue_push_head (queue, processor);
+    pool_size++;
+    processor = NULL;
+  }
+  G_UNLOCK (pool);
+
+  loudnorm_processor_free (processor);
+}
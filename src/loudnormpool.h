@@ -0,0 +1,51 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_POOL_H_
+#define _LOUDNORM_POOL_H_
+
+#include <glib.h>
+
+#include "loudnormprocessor.h"
+
+G_BEGIN_DECLS
+
+/* What a processor was made for. Pooled processors are only handed out
+ * again for the same key. */
+typedef struct {
+  LoudnormFormat format;
+  guint rate;
+  guint channels;
+  guint factor;                 /* measure decimation */
+  gboolean gating;              /* integrated loudness and LRA as well */
+} LoudnormPoolKey;
+
+/* A reset processor from the process-wide pool, or a new one if there is
+ * none for key. NULL on failure. */
+LoudnormProcessor *loudnorm_pool_acquire (const LoudnormPoolKey * key);
+
+/* Hands processor back for the next element with the same key, or frees
+ * it if the pool is full or its meter is sharded. The limiter and the
+ * true-peak meter are dropped, they depend on settings. */
+void loudnorm_pool_release (const LoudnormPoolKey * key,
+    LoudnormProcessor * processor);
+
+G_END_DECLS
+
+#endif
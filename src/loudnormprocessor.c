@@ -0,0 +1,835 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * The realtime gain. The meter runs over every block, with a cheap peak
+ * scan first: if no sample can reach the silence threshold the block
+ * only moves the meter on. Above the threshold the gain moves the gated
+ * mean short-term loudness of the last minute to the target, keeping the
+ * part of the deviation from it that fits the target loudness range,
+ * and follows the momentary loudness down. The one-pole smoother takes
+ * the result. Below the threshold the gain stays where it was.
+ *
+ * With the limiter on, the gain is applied in float instead, and the
+ * limiter keeps the peaks below its ceiling before the samples go back
+ * to the stream format. Silence runs through it as well, so the delay
+ * stays the same.
+ */
+
+#include "loudnormprocessor.h"
+#include "loudnormgain.h"
+#include "loudnormlimiter.h"
+#include "loudnormtruepeak.h"
+#include "loudnormsmoother.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Bound on how far the K-weighted loudness can lie above the sample peak
+ * in dBFS: the +4 dB shelf, the -0.691 offset and 1.5 dB for surround
+ * weights, plus 10 log10 (channels) on top */
+#define SILENCE_PEAK_MARGIN 4.8
+
+/* the gain holds the loudness range of the last minute */
+#define LRA_WINDOW_S 60
+
+/* peaks are scanned in blocks, which lets the compiler vectorize */
+#define QUIET_BLOCK 64
+
+/* settings of a new processor */
+#define DEFAULT_TARGET_LOUDNESS -23.0
+#define DEFAULT_TARGET_LRA 7.0
+#define DEFAULT_SILENCE_THRESHOLD -50.0
+#define DEFAULT_ATTACK_MS 100.0
+#define DEFAULT_RELEASE_MS 500.0
+
+/* frames per step of a gain ramp, 1.3 ms at 48 kHz */
+#define RAMP_CHUNK 64
+
+/* short-term values in the range window */
+#define LRA_WINDOW_VALUES (LRA_WINDOW_S * 10)
+
+/* State blobs are a fixed header followed by the slice levels and the
+ * range window as floats, all in host byte order. The magic is compared
+ * as a number, so a blob from the other byte order is refused. */
+#define STATE_MAGIC 0x4c4e5331
+#define STATE_VERSION 1
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t blocks;
+  double gain;                  /* dB, NAN before the first update */
+  uint32_t slices;
+  uint32_t window_len;
+} StateHeader;
+
+_Static_assert (sizeof (StateHeader) == 32, "packed state header");
+
+struct _LoudnormProcessor
+{
+  LoudnormFormat format;
+  unsigned int rate;
+  unsigned int channels;
+  LoudnormMeter *meter;
+  LoudnormSmoother smoother;
+
+  /* live changes ramp over measured audio */
+  LoudnormRamp target_loudness;
+  LoudnormRamp target_lra;
+  double silence_threshold;
+  /* full scale fraction no sample of a quiet block exceeds */
+  double quiet_peak;
+  /* the meter sees every frame, so it finds the peaks of what it reads */
+  int full_rate;
+  /* sample peak of the frames last measured or capped, -1.0 unless
+   * every sample was seen */
+  double peak;
+
+  /* NULL unless enabled, float frames of a RAMP_CHUNK on their way
+   * through it */
+  LoudnormLimiter *limiter;
+  float *limit_buf;
+
+  /* true-peak ceiling, NULL unless set. The ceiling is linear, bound is
+   * how far the oversampled signal can lie above the sample peak. */
+  LoudnormTruePeak *true_peak;
+  float *true_peak_buf;
+  double true_peak_ceiling;
+  double true_peak_bound;
+  int capped;
+  /* highest gain in dB the frames last capped take below the ceiling,
+   * as far as the cap found out */
+  double gain_limit;
+  /* measure leaves the cap to cap_true_peak on the applying thread */
+  int cap_deferred;
+};
+
+static const size_t sample_sizes[] = { 2, 4, 4 };
+
+LoudnormProcessor *
+loudnorm_processor_new (LoudnormFormat format, unsigned int rate,
+    unsigned int channels, unsigned int factor)
+{
+  LoudnormProcessor *processor;
+
+  if (format > LOUDNORM_FORMAT_F32)
+    return NULL;
+
+  processor = calloc (1, sizeof (LoudnormProcessor));
+  if (processor == NULL)
+    return NULL;
+
+  processor->format = format;
+  processor->rate = rate;
+  processor->channels = channels;
+  processor->meter = loudnorm_meter_new_decimated (rate, channels, factor);
+  processor->full_rate = factor <= 1;
+  processor->peak = -1.0;
+  processor->gain_limit = HUGE_VAL;
+  if (processor->meter == NULL ||
+      !loudnorm_meter_enable_range_window (processor->meter, LRA_WINDOW_S)) {
+    loudnorm_processor_free (processor);
+    return NULL;
+  }
+
+  loudnorm_smoother_init (&processor->smoother, DEFAULT_ATTACK_MS,
+      DEFAULT_RELEASE_MS);
+  loudnorm_processor_set_defaults (processor);
+
+  return processor;
+}
+
+void
+loudnorm_processor_free (LoudnormProcessor * processor)
+{
+  if (processor == NULL)
+    return;
+
+  loudnorm_meter_free (processor->meter);
+  loudnorm_limiter_free (processor->limiter);
+  free (processor->limit_buf);
+  loudnorm_true_peak_free (processor->true_peak);
+  free (processor->true_peak_buf);
+  free (processor);
+}
+
+void
+loudnorm_processor_reset (LoudnormProcessor * processor)
+{
+  loudnorm_meter_reset (processor->meter);
+  loudnorm_smoother_reset (&processor->smoother);
+  if (processor->true_peak)
+    loudnorm_true_peak_reset (processor->true_peak);
+  processor->peak = -1.0;
+  processor->gain_limit = HUGE_VAL;
+}
+
+void
+loudnorm_processor_set_defaults (LoudnormProcessor * processor)
+{
+  loudnorm_processor_set_target (processor, DEFAULT_TARGET_LOUDNESS,
+      DEFAULT_TARGET_LRA);
+  loudnorm_processor_set_silence_threshold (processor,
+      DEFAULT_SILENCE_THRESHOLD);
+  loudnorm_processor_set_times (processor, DEFAULT_ATTACK_MS,
+      DEFAULT_RELEASE_MS);
+  for (unsigned int c = 0; c < processor->channels; c++)
+    loudnorm_meter_set_channel_weight (processor->meter, c, 1.0);
+  loudnorm_processor_set_limiter (processor, 0.0, 0.0);
+  loudnorm_processor_set_true_peak_ceiling (processor, 0.0);
+  loudnorm_processor_defer_true_peak (processor, 0);
+}
+
+void
+loudnorm_processor_set_target (LoudnormProcessor * processor,
+    double loudness, double lra)
+{
+  loudnorm_ramp_init (&processor->target_loudness, loudness);
+  loudnorm_ramp_init (&processor->target_lra, lra);
+}
+
+void
+loudnorm_processor_ramp_target (LoudnormProcessor * processor,
+    double loudness, double lra, double ramp_ms)
+{
+  loudnorm_ramp_set (&processor->target_loudness, loudness, ramp_ms);
+  loudnorm_ramp_set (&processor->target_lra, lra, ramp_ms);
+}
+
+void
+loudnorm_processor_set_silence_threshold (LoudnormProcessor * processor,
+    double threshold)
+{
+  processor->silence_threshold = threshold;
+  processor->quiet_peak = pow (10, (threshold - SILENCE_PEAK_MARGIN -
+          10 * log10 (processor->channels)) / 20.0);
+}
+
+void
+loudnorm_processor_set_times (LoudnormProcessor * processor,
+    double attack_ms, double release_ms)
+{
+  processor->smoother.attack_ms = attack_ms;
+  processor->smoother.release_ms = release_ms;
+}
+
+int
+loudnorm_processor_set_limiter (LoudnormProcessor * processor,
+    double lookahead_ms, double ceiling_db)
+{
+  loudnorm_limiter_free (processor->limiter);
+  free (processor->limit_buf);
+  processor->limiter = NULL;
+  processor->limit_buf = NULL;
+
+  if (lookahead_ms <= 0.0)
+    return 1;
+
+  processor->limiter = loudnorm_limiter_new (processor->rate,
+      processor->channels, lookahead_ms, ceiling_db);
+  processor->limit_buf = malloc ((size_t) RAMP_CHUNK * processor->channels *
+      sizeof (float));
+  if (processor->limiter == NULL || processor->limit_buf == NULL) {
+    loudnorm_processor_set_limiter (processor, 0.0, 0.0);
+    return 0;
+  }
+
+  return 1;
+}
+
+int
+loudnorm_processor_set_true_peak_ceiling (LoudnormProcessor * processor,
+    double ceiling_db)
+{
+  loudnorm_true_peak_free (processor->true_peak);
+  free (processor->true_peak_buf);
+  processor->true_peak = NULL;
+  processor->true_peak_buf = NULL;
+  processor->capped = 0;
+  processor->gain_limit = HUGE_VAL;
+
+  if (ceiling_db >= 0.0)
+    return 1;
+
+  processor->true_peak = loudnorm_true_peak_new (processor->channels);
+  processor->true_peak_buf = malloc ((size_t) RAMP_CHUNK *
+      processor->channels * sizeof (float));
+  if (processor->true_peak == NULL || processor->true_peak_buf == NULL) {
+    loudnorm_processor_set_true_peak_ceiling (processor, 0.0);
+    return 0;
+  }
+  processor->true_peak_ceiling = pow (10, ceiling_db / 20.0);
+  processor->true_peak_bound = loudnorm_true_peak_get_bound ();
+
+  return 1;
+}
+
+void
+loudnorm_processor_defer_true_peak (LoudnormProcessor * processor,
+    int defer)
+{
+  processor->cap_deferred = defer;
+}
+
+unsigned int
+loudnorm_processor_get_latency (const LoudnormProcessor * processor)
+{
+  return processor->limiter ?
+      loudnorm_limiter_get_delay (processor->limiter) : 0;
+}
+
+void
+loudnorm_processor_flush (LoudnormProcessor * processor)
+{
+  if (processor->limiter)
+    loudnorm_limiter_reset (processor->limiter);
+}
+
+LoudnormMeter *
+loudnorm_processor_get_meter (LoudnormProcessor * processor)
+{
+  return processor->meter;
+}
+
+void
+loudnorm_processor_add (LoudnormProcessor * processor, const void *data,
+    size_t frames)
+{
+  switch (processor->format) {
+    case LOUDNORM_FORMAT_S16:
+      loudnorm_meter_add_s16 (processor->meter, data, frames);
+      break;
+    case LOUDNORM_FORMAT_S32:
+      loudnorm_meter_add_s32 (processor->meter, data, frames);
+      break;
+    case LOUDNORM_FORMAT_F32:
+      loudnorm_meter_add_f32 (processor->meter, data, frames);
+      break;
+  }
+}
+
+/* Largest absolute sample, found in blocks, which lets the compiler
+ * vectorize. Stops after the first block that goes beyond limit. */
+#define DEFINE_PEAK(name, type)                                              \
+static double                                                                \
+name (const type * s, size_t n, double limit)                                \
+{                                                                            \
+  type hi = 0, lo = 0;                                                       \
+  size_t i = 0;                                                              \
+                                                                             \
+  for (; i + QUIET_BLOCK <= n; i += QUIET_BLOCK) {                           \
+    for (size_t j = 0; j < QUIET_BLOCK; j++) {                               \
+      hi = s[i + j] > hi ? s[i + j] : hi;                                    \
+      lo = s[i + j] < lo ? s[i + j] : lo;                                    \
+    }                                                                        \
+    if ((double) hi > limit || -(double) lo > limit)                         \
+      break;                                                                 \
+  }                                                                          \
+                                                                             \
+  for (; i + QUIET_BLOCK > n && i < n; i++) {                                \
+    hi = s[i] > hi ? s[i] : hi;                                              \
+    lo = s[i] < lo ? s[i] : lo;                                              \
+  }                                                                          \
+                                                                             \
+  return (double) hi > -(double) lo ? (double) hi : -(double) lo;            \
+}
+
+DEFINE_PEAK (peak_s16, int16_t)
+DEFINE_PEAK (peak_s32, int32_t)
+DEFINE_PEAK (peak_f32, float)
+
+/* Sample peak of n samples, 1.0 being full scale. Once a sample goes
+ * beyond limit the rest is left out: the silence check only needs to
+ * know whether any sample could reach the threshold, which is much
+ * cheaper to find out than the loudness. */
+static double
+loudnorm_processor_scan_peak (const LoudnormProcessor * processor,
+    const void *data, size_t samples, double limit)
+{
+  /* the negative end of the integer range is full scale */
+  switch (processor->format) {
+    case LOUDNORM_FORMAT_S16:
+      return peak_s16 (data, samples, limit * 32768.0) / 32768.0;
+    case LOUDNORM_FORMAT_S32:
+      return peak_s32 (data, samples, limit * 2147483648.0) / 2147483648.0;
+    case LOUDNORM_FORMAT_F32:
+      return peak_f32 (data, samples, limit);
+  }
+  return 0.0;
+}
+
+/* Turns the current meter readings into the smoothed gain in dB,
+ * frames is the amount of audio measured since the last update */
+static double
+loudnorm_processor_update_gain (LoudnormProcessor * processor,
+    size_t frames)
+{
+  const LoudnormMeter *meter = processor->meter;
+  double target = processor->target_loudness.value;
+  double lra = processor->target_lra.value;
+  double shortterm = loudnorm_meter_shortterm (meter);
+  double momentary = loudnorm_meter_momentary (meter);
+  double center, range, shortterm_gain, momentary_gain;
+
+  range = loudnorm_meter_window_range (meter, &center);
+
+  if (shortterm == -HUGE_VAL)
+    shortterm = -23.0;
+
+  shortterm_gain = target - shortterm;
+  momentary_gain = target - momentary;
+
+  /* Keep the part of the deviation from the recent mean that fits the
+   * target range. Until there is a mean the short-term loudness is
+   * pulled all the way to the target. */
+  if (center != -HUGE_VAL) {
+    double kept = range > lra ? lra / range : 1.0;
+
+    shortterm_gain += kept * (shortterm - center);
+    if (momentary != -HUGE_VAL)
+      momentary_gain += kept * (momentary - center);
+  }
+
+  return loudnorm_smoother_push (&processor->smoother,
+      momentary_gain < shortterm_gain ? momentary_gain : shortterm_gain,
+      frames * 1000.0 / processor->rate);
+}
+
+/* Conversions for the limiter and the true-peak meter, 1.0 being full
+ * scale. Going back saturates and truncates like the gain kernels. */
+static void
+samples_to_float (LoudnormFormat format, const void *src, float *dst,
+    size_t n, float gain)
+{
+  switch (format) {
+    case LOUDNORM_FORMAT_S16:{
+      const int16_t *s = src;
+      float scale = gain / 32768.0f;
+
+      for (size_t i = 0; i < n; i++)
+        dst[i] = s[i] * scale;
+      break;
+    }
+    case LOUDNORM_FORMAT_S32:{
+      const int32_t *s = src;
+      float scale = gain / 2147483648.0f;
+
+      for (size_t i = 0; i < n; i++)
+        dst[i] = (float) s[i] * scale;
+      break;
+    }
+    case LOUDNORM_FORMAT_F32:{
+      const float *s = src;
+
+      for (size_t i = 0; i < n; i++)
+        dst[i] = s[i] * gain;
+      break;
+    }
+  }
+}
+
+static size_t
+samples_from_float (LoudnormFormat format, const float *src, void *dst,
+    size_t n)
+{
+  size_t clipped = 0;
+
+  switch (format) {
+    case LOUDNORM_FORMAT_S16:{
+      int16_t *d = dst;
+
+      for (size_t i = 0; i < n; i++) {
+        float v = src[i] * 32768.0f;
+
+        clipped += (v > 32767.0f) | (v < -32768.0f);
+        v = v > 32767.0f ? 32767.0f : v;
+        d[i] = (int16_t) (v < -32768.0f ? -32768.0f : v);
+      }
+      break;
+    }
+    case LOUDNORM_FORMAT_S32:{
+      int32_t *d = dst;
+
+      for (size_t i = 0; i < n; i++) {
+        double v = src[i] * 2147483648.0;
+
+        clipped += (v > 2147483647.0) | (v < -2147483648.0);
+        v = v > 2147483647.0 ? 2147483647.0 : v;
+        d[i] = (int32_t) (v < -2147483648.0 ? -2147483648.0 : v);
+      }
+      break;
+    }
+    case LOUDNORM_FORMAT_F32:{
+      float *d = dst;
+
+      for (size_t i = 0; i < n; i++) {
+        clipped += (src[i] > 1.0f) | (src[i] < -1.0f);
+        d[i] = src[i];
+      }
+      break;
+    }
+  }
+
+  return clipped;
+}
+
+/* Lowers gain as far as the true-peak ceiling needs. Blocks whose sample
+ * peak can't get there even at the bound of the oversampling filter, and
+ * blocks that are not scaled at all (peak 0.0), only move the filter
+ * history on; their gain limit is what the bound allows. */
+static double
+loudnorm_processor_cap (LoudnormProcessor * processor, const void *data,
+    size_t frames, double gain, double peak)
+{
+  size_t stride = processor->channels * sample_sizes[processor->format];
+  double linear_gain = pow (10, gain / 20.0);
+  double bounded_peak = peak * processor->true_peak_bound;
+
+  processor->capped = 0;
+
+  if (bounded_peak * linear_gain <= processor->true_peak_ceiling) {
+    size_t n = frames < LOUDNORM_TRUE_PEAK_HISTORY ?
+        frames : LOUDNORM_TRUE_PEAK_HISTORY;
+
+    samples_to_float (processor->format,
+        (const char *) data + (frames - n) * stride,
+        processor->true_peak_buf, n * processor->channels, 1.0f);
+    loudnorm_true_peak_skip (processor->true_peak,
+        processor->true_peak_buf, n);
+    processor->gain_limit = bounded_peak > 0.0 ?
+        20.0 * log10 (processor->true_peak_ceiling / bounded_peak) : HUGE_VAL;
+    return gain;
+  }
+
+  peak = 0.0;
+  for (size_t offset = 0; offset < frames; offset += RAMP_CHUNK) {
+    size_t n = frames - offset < RAMP_CHUNK ? frames - offset : RAMP_CHUNK;
+    double p;
+
+    samples_to_float (processor->format,
+        (const char *) data + offset * stride, processor->true_peak_buf,
+        n * processor->channels, 1.0f);
+    p = loudnorm_true_peak_process (processor->true_peak,
+        processor->true_peak_buf, n);
+    peak = p > peak ? p : peak;
+  }
+
+  processor->gain_limit = peak > 0.0 ?
+      20.0 * log10 (processor->true_peak_ceiling / peak) : HUGE_VAL;
+  if (gain > processor->gain_limit) {
+    gain = processor->gain_limit;
+    processor->capped = 1;
+  }
+
+  return gain;
+}
+
+double
+loudnorm_processor_cap_true_peak (LoudnormProcessor * processor,
+    const void *data, size_t frames, double gain)
+{
+  if (processor->true_peak == NULL) {
+    processor->peak = -1.0;
+    return gain;
+  }
+
+  processor->peak = loudnorm_processor_peak (processor, data, frames);
+  return loudnorm_processor_cap (processor, data, frames, gain,
+      processor->peak);
+}
+
+int
+loudnorm_processor_gain_is_capped (const LoudnormProcessor * processor)
+{
+  return processor->capped;
+}
+
+double
+loudnorm_processor_get_gain_limit (const LoudnormProcessor * processor)
+{
+  return processor->gain_limit;
+}
+
+double
+loudnorm_processor_measure (LoudnormProcessor * processor,
+    const void *data, size_t frames, int *silent)
+{
+  double duration_ms = frames * 1000.0 / processor->rate;
+  double peak, gain;
+  int is_silent;
+
+  /* settings keep ramping through silence */
+  loudnorm_ramp_advance (&processor->target_loudness, duration_ms);
+  loudnorm_ramp_advance (&processor->target_lra, duration_ms);
+
+  /* a quiet block is scanned to the end. A loud one stops the scan early
+   * and the meter finds the peak on its way, unless it skips frames. */
+  peak = loudnorm_processor_scan_peak (processor, data,
+      frames * processor->channels, processor->quiet_peak);
+  if (peak <= processor->quiet_peak) {
+    loudnorm_meter_add_silence (processor->meter, frames);
+  } else {
+    double rest;
+
+    loudnorm_meter_take_peak (processor->meter);
+    loudnorm_processor_add (processor, data, frames);
+    rest = loudnorm_meter_take_peak (processor->meter);
+    peak = !processor->full_rate ? -1.0 : rest > peak ? rest : peak;
+  }
+  /* a deferred cap finds the peak on the applying thread */
+  if (!processor->cap_deferred)
+    processor->peak = peak;
+
+  is_silent = loudnorm_meter_momentary (processor->meter) <
+      processor->silence_threshold;
+  if (silent)
+    *silent = is_silent;
+
+  if (is_silent) {
+    double gain = processor->smoother.primed ? processor->smoother.value : 0.0;
+
+    /* silence is not scaled, the history still has to follow */
+    if (processor->true_peak && !processor->cap_deferred)
+      loudnorm_processor_cap (processor, data, frames, gain, 0.0);
+    return gain;
+  }
+
+  gain = loudnorm_processor_update_gain (processor, frames);
+  if (processor->true_peak == NULL || processor->cap_deferred)
+    return gain;
+
+  if (peak < 0.0)
+    processor->peak = loudnorm_processor_peak (processor, data, frames);
+  return loudnorm_processor_cap (processor, data, frames, gain,
+      processor->peak);
+}
+
+/* Scales frames through the limiter, RAMP_CHUNK frames at a time */
+static size_t
+loudnorm_processor_limit (LoudnormProcessor * processor, const void *src,
+    void *dst, size_t frames, double linear_gain)
+{
+  size_t stride = processor->channels * sample_sizes[processor->format];
+  size_t clipped = 0;
+
+  for (size_t offset = 0; offset < frames; offset += RAMP_CHUNK) {
+    size_t n = frames - offset < RAMP_CHUNK ? frames - offset : RAMP_CHUNK;
+    size_t samples = n * processor->channels;
+
+    if (src)
+      samples_to_float (processor->format,
+          (const char *) src + offset * stride, processor->limit_buf,
+          samples, linear_gain);
+    else
+      memset (processor->limit_buf, 0, samples * sizeof (float));
+    loudnorm_limiter_process (processor->limiter, processor->limit_buf, n);
+    clipped += samples_from_float (processor->format, processor->limit_buf,
+        (char *) dst + offset * stride, samples);
+  }
+
+  return clipped;
+}
+
+size_t
+loudnorm_processor_apply (LoudnormProcessor * processor, const void *src,
+    void *dst, size_t frames, double gain)
+{
+  /* one pow () per block, the kernels do the clamping */
+  double linear_gain = pow (10, gain / 20.0);
+  size_t samples = frames * processor->channels;
+
+  if (processor->limiter)
+    return loudnorm_processor_limit (processor, src, dst, frames,
+        linear_gain);
+
+  switch (processor->format) {
+    case LOUDNORM_FORMAT_S16:
+      return loudnorm_gain_apply_s16 (src, dst, samples, linear_gain);
+    case LOUDNORM_FORMAT_S32:
+      return loudnorm_gain_apply_s32 (src, dst, samples, linear_gain);
+    case LOUDNORM_FORMAT_F32:
+      return loudnorm_gain_apply_f32 (src, dst, samples, linear_gain);
+  }
+  return 0;
+}
+
+size_t
+loudnorm_processor_apply_ramp (LoudnormProcessor * processor,
+    const void *src, void *dst, size_t frames, double from_gain,
+    double to_gain)
+{
+  size_t stride = processor->channels * sample_sizes[processor->format];
+  size_t chunks = (frames + RAMP_CHUNK - 1) / RAMP_CHUNK;
+  size_t clipped = 0;
+
+  /* steps of equal size in dB, the last chunk lands on to_gain */
+  for (size_t c = 0; c < chunks; c++) {
+    size_t offset = c * RAMP_CHUNK;
+    size_t n = frames - offset < RAMP_CHUNK ? frames - offset : RAMP_CHUNK;
+
+    clipped += loudnorm_processor_apply (processor,
+        (const char *) src + offset * stride, (char *) dst + offset * stride,
+        n, from_gain + (to_gain - from_gain) * (c + 1) / chunks);
+  }
+
+  return clipped;
+}
+
+double
+loudnorm_processor_peak (const LoudnormProcessor * processor,
+    const void *data, size_t frames)
+{
+  return loudnorm_processor_scan_peak (processor, data,
+      frames * processor->channels, HUGE_VAL);
+}
+
+int
+loudnorm_processor_get_last_peak (const LoudnormProcessor * processor,
+    double *peak)
+{
+  if (processor->peak < 0.0)
+    return 0;
+
+  *peak = processor->peak;
+  return 1;
+}
+
+size_t
+loudnorm_processor_process (LoudnormProcessor * processor, const void *src,
+    void *dst, size_t frames, double *gain)
+{
+  int silent;
+  double db = loudnorm_processor_measure (processor, src, frames, &silent);
+
+  if (gain)
+    *gain = silent ? 0.0 : db;
+
+  /* silence goes out untouched, no point in scaling the noise floor */
+  if (silent && processor->limiter)
+    return loudnorm_processor_apply (processor, src, dst, frames, 0.0);
+  if (silent) {
+    if (dst != src)
+      memcpy (dst, src,
+          frames * processor->channels * sample_sizes[processor->format]);
+    return 0;
+  }
+
+  return loudnorm_processor_apply (processor, src, dst, frames, db);
+}
+
+size_t
+loudnorm_processor_get_footprint (const LoudnormProcessor * processor)
+{
+  size_t footprint = sizeof (LoudnormProcessor) +
+      loudnorm_meter_get_footprint (processor->meter);
+
+  if (processor->limiter)
+    footprint += loudnorm_limiter_get_footprint (processor->limiter) +
+        (size_t) RAMP_CHUNK * processor->channels * sizeof (float);
+  if (processor->true_peak)
+    footprint += loudnorm_true_peak_get_footprint (processor->true_peak) +
+        (size_t) RAMP_CHUNK * processor->channels * sizeof (float);
+
+  return footprint;
+}
+
+size_t
+loudnorm_processor_drain (LoudnormProcessor * processor, void *dst)
+{
+  size_t frames = loudnorm_processor_get_latency (processor);
+
+  if (frames > 0)
+    loudnorm_processor_limit (processor, NULL, dst, frames, 1.0);
+
+  return frames;
+}
+
+size_t
+loudnorm_processor_get_state_size (const LoudnormProcessor * processor)
+{
+  /* the windows have the same length for every processor */
+  (void) processor;
+
+  return sizeof (StateHeader) +
+      (LOUDNORM_METER_SLICES + LRA_WINDOW_VALUES) * sizeof (float);
+}
+
+size_t
+loudnorm_processor_save_state (const LoudnormProcessor * processor,
+    void *dst, size_t size)
+{
+  StateHeader header = { .magic = STATE_MAGIC, .version = STATE_VERSION };
+  float *levels = (float *) ((uint8_t *) dst + sizeof (StateHeader));
+
+  if (size < loudnorm_processor_get_state_size (processor))
+    return 0;
+
+  header.blocks = loudnorm_meter_get_slices (processor->meter, levels);
+  header.gain = processor->smoother.primed ? processor->smoother.value : NAN;
+  header.slices = LOUDNORM_METER_SLICES;
+  header.window_len = loudnorm_meter_get_window (processor->meter,
+      levels + LOUDNORM_METER_SLICES, LRA_WINDOW_VALUES);
+  memcpy (dst, &header, sizeof (StateHeader));
+
+  return sizeof (StateHeader) +
+      (LOUDNORM_METER_SLICES + header.window_len) * sizeof (float);
+}
+
+int
+loudnorm_processor_restore_state (LoudnormProcessor * processor,
+    const void *src, size_t size)
+{
+  StateHeader header;
+  float *levels;
+
+  loudnorm_processor_reset (processor);
+
+  if (size < sizeof (StateHeader))
+    return 0;
+  memcpy (&header, src, sizeof (StateHeader));
+  if (header.magic != STATE_MAGIC || header.version != STATE_VERSION ||
+      header.slices != LOUDNORM_METER_SLICES ||
+      header.window_len > LRA_WINDOW_VALUES ||
+      size < sizeof (StateHeader) +
+      (header.slices + (size_t) header.window_len) * sizeof (float))
+    return 0;
+
+  /* the floats in src need not be aligned */
+  levels = malloc ((header.slices + (size_t) header.window_len) *
+      sizeof (float));
+  if (levels == NULL)
+    return 0;
+  memcpy (levels, (const uint8_t *) src + sizeof (StateHeader),
+      (header.slices + (size_t) header.window_len) * sizeof (float));
+
+  loudnorm_meter_set_slices (processor->meter, levels, header.blocks);
+  loudnorm_meter_set_window (processor->meter, levels + header.slices,
+      header.window_len);
+  free (levels);
+
+  if (isfinite (header.gain)) {
+    processor->smoother.value = header.gain;
+    processor->smoother.primed = 1;
+  }
+
+  return 1;
+}
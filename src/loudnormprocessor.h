@@ -0,0 +1,193 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef _LOUDNORM_PROCESSOR_H_
+#define _LOUDNORM_PROCESSOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "loudnormmeter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  LOUDNORM_FORMAT_S16,
+  LOUDNORM_FORMAT_S32,
+  LOUDNORM_FORMAT_F32
+} LoudnormFormat;
+
+/* The realtime normalization of the element without GStreamer around
+ * it: measures blocks of interleaved samples, turns the short-term and
+ * momentary loudness into a smoothed gain and applies it. Starts out at
+ * -23 LUFS, 7 LU, a -50 LUFS silence threshold and 100/500 ms attack
+ * and release. */
+typedef struct _LoudnormProcessor LoudnormProcessor;
+
+/* Measures every factor-th frame, see loudnorm_meter_new_decimated.
+ * Returns NULL on failure. */
+LoudnormProcessor *loudnorm_processor_new (LoudnormFormat format,
+    unsigned int rate, unsigned int channels, unsigned int factor);
+void loudnorm_processor_free (LoudnormProcessor * processor);
+
+/* Forgets the measurement and the gain */
+void loudnorm_processor_reset (LoudnormProcessor * processor);
+
+/* Puts every setting back to what new gives it: the targets without a
+ * ramp, the silence threshold, attack and release, unit channel weights,
+ * no limiter, no true-peak ceiling and no deferred cap. The measurement
+ * stays, reset forgets it. */
+void loudnorm_processor_set_defaults (LoudnormProcessor * processor);
+
+/* Settings may change between blocks */
+void loudnorm_processor_set_target (LoudnormProcessor * processor,
+    double loudness, double lra);
+/* Like set_target, but moves from the current targets to the new ones
+ * over ramp_ms of measured audio, so the gain does not jump */
+void loudnorm_processor_ramp_target (LoudnormProcessor * processor,
+    double loudness, double lra, double ramp_ms);
+void loudnorm_processor_set_silence_threshold (LoudnormProcessor *
+    processor, double threshold);
+void loudnorm_processor_set_times (LoudnormProcessor * processor,
+    double attack_ms, double release_ms);
+
+/* Runs the output through a lookahead limiter with the given ceiling in
+ * dBFS, which delays it by lookahead_ms; 0 turns it off. Returns 0 when
+ * out of memory, the limiter is off then. */
+int loudnorm_processor_set_limiter (LoudnormProcessor * processor,
+    double lookahead_ms, double ceiling_db);
+
+/* Keeps the true peak of the output below ceiling_db dBTP by lowering
+ * the gain where needed, 0 or above turns it off. Returns 0 when out of
+ * memory, the ceiling is off then. */
+int loudnorm_processor_set_true_peak_ceiling (LoudnormProcessor *
+    processor, double ceiling_db);
+
+/* With defer set measure leaves the true-peak ceiling alone, for callers
+ * that measure on one thread and apply on another. The applying thread
+ * then caps each gain with cap_true_peak against the frames it scales,
+ * and owns the true-peak state and the last peak. */
+void loudnorm_processor_defer_true_peak (LoudnormProcessor * processor,
+    int defer);
+
+/* Frames the output lags behind the input */
+unsigned int loudnorm_processor_get_latency (const LoudnormProcessor *
+    processor);
+
+/* Writes the frames still held by the limiter to dst, room for latency
+ * frames, and returns how many. The delay is silent afterwards. */
+size_t loudnorm_processor_drain (LoudnormProcessor * processor, void *dst);
+
+/* Drops the frames held by the limiter without writing them */
+void loudnorm_processor_flush (LoudnormProcessor * processor);
+
+/* The meter, for channel weights, shards and loudness queries. Owned by
+ * the processor. */
+LoudnormMeter *loudnorm_processor_get_meter (LoudnormProcessor * processor);
+
+/* Only measures frames, e.g. for an analysis pass */
+void loudnorm_processor_add (LoudnormProcessor * processor,
+    const void *data, size_t frames);
+
+/* Measures frames and returns the smoothed gain in dB, capped by the
+ * true-peak ceiling if there is one and it is not deferred. While the
+ * momentary loudness is below the silence threshold the gain stays
+ * frozen and silent (if not NULL) is set. Frames without a sample that
+ * could reach the threshold are not even filtered. */
+double loudnorm_processor_measure (LoudnormProcessor * processor,
+    const void *data, size_t frames, int *silent);
+
+/* Lowers gain dB as far as needed to keep frames scaled by it below the
+ * true-peak ceiling. measure does this already, this is for gains that
+ * come from elsewhere. */
+double loudnorm_processor_cap_true_peak (LoudnormProcessor * processor,
+    const void *data, size_t frames, double gain);
+
+/* 1 if the true-peak ceiling lowered the last gain. That gain has to
+ * hold from the first frame of the block on, a ramp down to it would
+ * let the first peaks through. */
+int loudnorm_processor_gain_is_capped (const LoudnormProcessor *
+    processor);
+
+/* Highest gain in dB the frames last capped can take below the true-peak
+ * ceiling, HUGE_VAL without one or for frames that were not scaled. The
+ * cheap check may put it lower than it is. A ramp that starts above it
+ * can push the first peaks through, the end gain has to hold from the
+ * first frame then. */
+double loudnorm_processor_get_gain_limit (const LoudnormProcessor *
+    processor);
+
+/* Scales frames from src into dst, which may be the same memory, by gain
+ * dB. Returns the number of clipped samples. */
+size_t loudnorm_processor_apply (LoudnormProcessor * processor,
+    const void *src, void *dst, size_t frames, double gain);
+
+/* Like apply, but the gain moves from from_gain to to_gain dB in short
+ * steps across the frames, which hides the step between two blocks */
+size_t loudnorm_processor_apply_ramp (LoudnormProcessor * processor,
+    const void *src, void *dst, size_t frames, double from_gain,
+    double to_gain);
+
+/* Largest absolute sample of frames, 1.0 being full scale */
+double loudnorm_processor_peak (const LoudnormProcessor * processor,
+    const void *data, size_t frames);
+
+/* The same for the frames last given to measure or cap_true_peak, which
+ * found it on the way. Returns 0 if they did not see every sample, at a
+ * reduced measure rate or without a true-peak ceiling. */
+int loudnorm_processor_get_last_peak (const LoudnormProcessor * processor,
+    double *peak);
+
+/* Measures and applies in one go. Silence is copied as it is, or goes
+ * through the limiter at unity gain when it is on. gain (if not NULL)
+ * gets the gain in dB, 0.0 for silence. Returns the number of clipped
+ * samples. */
+size_t loudnorm_processor_process (LoudnormProcessor * processor,
+    const void *src, void *dst, size_t frames, double *gain);
+
+/* Warm start: the measurement windows and the smoothed gain as a blob
+ * of at most get_state_size bytes, so a restarted stream starts out at
+ * the gain it had instead of measuring for seconds first. Settings are
+ * not part of it. */
+size_t loudnorm_processor_get_state_size (const LoudnormProcessor *
+    processor);
+
+/* Writes the state to dst, aligned for floats, and returns its size, 0
+ * if size is too small */
+size_t loudnorm_processor_save_state (const LoudnormProcessor * processor,
+    void *dst, size_t size);
+
+/* Resets the processor and loads a saved state, which may come from a
+ * stream of another rate or layout. Returns 0 if src is not a state
+ * blob, the processor stays reset then. */
+int loudnorm_processor_restore_state (LoudnormProcessor * processor,
+    const void *src, size_t size);
+
+/* Bytes held by the processor */
+size_t loudnorm_processor_get_footprint (const LoudnormProcessor *
+    processor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
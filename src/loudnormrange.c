@@ -0,0 +1,269 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * Sliding loudness range. The window is a ring of bin indices, the bins
+ * are counted in a Fenwick tree: an update and a prefix count walk
+ * log2(RANGE_BINS) nodes, and finding the bin holding the k-th smallest
+ * value descends the tree once. A second tree sums the energies, for
+ * the relative gate and the mean loudness above it. The energy of every
+ * bin comes from one table shared by all ranges, built on first use.
+ */
+
+#include "loudnormrange.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* 0.1 LU bins from -70 LUFS up, power of two for the tree descent */
+#define RANGE_BINS 1024
+#define RANGE_MIN -70.0
+#define RANGE_STEP 0.1
+
+/* EBU Tech 3342 gate and percentiles */
+#define RANGE_GATE -20.0
+#define RANGE_LOW 0.10
+#define RANGE_HIGH 0.95
+
+/* slot of a value below the absolute gate */
+#define RANGE_GATED -1
+
+struct _LoudnormRange
+{
+  /* bin of every value in the window, oldest at next once full */
+  int16_t *ring;
+  unsigned int length;
+  unsigned int next;
+  unsigned int filled;
+
+  /* Fenwick trees of the bin counts and energies, 1-based */
+  uint32_t tree[RANGE_BINS + 1];
+  double energy_tree[RANGE_BINS + 1];
+  unsigned int count;
+  double energy;
+};
+
+static double
+bin_loudness (int bin)
+{
+  return RANGE_MIN + (bin + 0.5) * RANGE_STEP;
+}
+
+static double bin_energies[RANGE_BINS];
+static pthread_once_t bin_energies_once = PTHREAD_ONCE_INIT;
+
+static void
+bin_energies_init (void)
+{
+  for (int bin = 0; bin < RANGE_BINS; bin++)
+    bin_energies[bin] = pow (10.0, bin_loudness (bin) / 10.0);
+}
+
+static void
+tree_add (LoudnormRange * range, int bin, int delta)
+{
+  double energy = delta * bin_energies[bin];
+
+  range->count += delta;
+  range->energy += energy;
+
+  for (unsigned int i = bin + 1; i <= RANGE_BINS; i += i & -i) {
+    range->tree[i] += delta;
+    range->energy_tree[i] += energy;
+  }
+}
+
+/* Number and energy of the values in bins below bin */
+static unsigned int
+tree_count_below (const LoudnormRange * range, int bin, double *energy)
+{
+  unsigned int count = 0;
+
+  *energy = 0.0;
+  for (unsigned int i = bin; i > 0; i -= i & -i) {
+    count += range->tree[i];
+    *energy += range->energy_tree[i];
+  }
+  return count;
+}
+
+/* Bin of the k-th smallest value, k from 0 */
+static int
+tree_find (const LoudnormRange * range, unsigned int k)
+{
+  unsigned int pos = 0;
+
+  for (unsigned int step = RANGE_BINS; step > 0; step >>= 1) {
+    if (pos + step <= RANGE_BINS && range->tree[pos + step] <= k) {
+      pos += step;
+      k -= range->tree[pos];
+    }
+  }
+  return pos;
+}
+
+LoudnormRange *
+loudnorm_range_new (unsigned int length)
+{
+  LoudnormRange *range;
+
+  if (length == 0)
+    return NULL;
+
+  pthread_once (&bin_energies_once, bin_energies_init);
+
+  range = calloc (1, sizeof (LoudnormRange));
+  if (range == NULL)
+    return NULL;
+
+  range->ring = malloc (length * sizeof (int16_t));
+  if (range->ring == NULL) {
+    free (range);
+    return NULL;
+  }
+  range->length = length;
+
+  return range;
+}
+
+void
+loudnorm_range_free (LoudnormRange * range)
+{
+  if (range == NULL)
+    return;
+
+  free (range->ring);
+  free (range);
+}
+
+static void
+loudnorm_range_reset_sums (LoudnormRange * range)
+{
+  for (unsigned int i = 0; i <= RANGE_BINS; i++) {
+    range->tree[i] = 0;
+    range->energy_tree[i] = 0.0;
+  }
+  range->count = 0;
+  range->energy = 0.0;
+}
+
+void
+loudnorm_range_reset (LoudnormRange * range)
+{
+  loudnorm_range_reset_sums (range);
+  range->next = 0;
+  range->filled = 0;
+}
+
+void
+loudnorm_range_push (LoudnormRange * range, double loudness)
+{
+  int bin = RANGE_GATED;
+
+  if (range->filled == range->length) {
+    int old = range->ring[range->next];
+
+    if (old != RANGE_GATED)
+      tree_add (range, old, -1);
+  } else {
+    range->filled++;
+  }
+
+  if (loudness >= RANGE_MIN) {
+    bin = (int) ((loudness - RANGE_MIN) / RANGE_STEP);
+    if (bin >= RANGE_BINS)
+      bin = RANGE_BINS - 1;
+
+    tree_add (range, bin, 1);
+  }
+
+  /* the running sums must not drift away from an empty window */
+  if (range->count == 0)
+    loudnorm_range_reset_sums (range);
+
+  range->ring[range->next] = bin;
+  range->next = (range->next + 1) % range->length;
+}
+
+unsigned int
+loudnorm_range_get_count (const LoudnormRange * range)
+{
+  return range->count;
+}
+
+double
+loudnorm_range_get (const LoudnormRange * range, double *mean)
+{
+  unsigned int below, count;
+  double gate, energy;
+  int bin = 0, low, high;
+
+  if (mean)
+    *mean = -HUGE_VAL;
+  if (range->count == 0)
+    return 0.0;
+
+  gate = 10.0 * log10 (range->energy / range->count) + RANGE_GATE;
+  if (gate > RANGE_MIN) {
+    bin = (int) ((gate - RANGE_MIN) / RANGE_STEP);
+    if (bin >= RANGE_BINS)
+      bin = RANGE_BINS - 1;
+  }
+
+  below = tree_count_below (range, bin, &energy);
+  count = range->count - below;
+  if (count == 0)
+    return 0.0;
+
+  if (mean)
+    *mean = 10.0 * log10 ((range->energy - energy) / count);
+
+  low = tree_find (range, below + (unsigned int) ((count - 1) * RANGE_LOW +
+          0.5));
+  high = tree_find (range, below + (unsigned int) ((count - 1) * RANGE_HIGH +
+          0.5));
+  return (high - low) * RANGE_STEP;
+}
+
+unsigned int
+loudnorm_range_get_values (const LoudnormRange * range, float *values,
+    unsigned int n)
+{
+  unsigned int start;
+
+  if (n > range->filled)
+    n = range->filled;
+  start = (range->next + range->length - n) % range->length;
+
+  for (unsigned int i = 0; i < n; i++) {
+    int bin = range->ring[(start + i) % range->length];
+
+    values[i] = bin == RANGE_GATED ? -HUGE_VAL : bin_loudness (bin);
+  }
+
+  return n;
+}
+
+size_t
+loudnorm_range_get_footprint (const LoudnormRange * range)
+{
+  return sizeof (LoudnormRange) + range->length * sizeof (int16_t);
+}
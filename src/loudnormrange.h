@@ -0,0 +1,64 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_RANGE_H_
+#define _LOUDNORM_RANGE_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Loudness range (EBU Tech 3342) of the last length short-term values,
+ * kept in 0.1 LU bins so that pushing a value, dropping the oldest one
+ * and looking up the percentiles all cost the same small amount no
+ * matter how long the stream runs. */
+typedef struct _LoudnormRange LoudnormRange;
+
+LoudnormRange *loudnorm_range_new (unsigned int length);
+void loudnorm_range_free (LoudnormRange * range);
+void loudnorm_range_reset (LoudnormRange * range);
+
+/* Adds a short-term loudness in LUFS, replacing the oldest once full.
+ * Values below -70 LUFS (and -HUGE_VAL) only take up their slot. */
+void loudnorm_range_push (LoudnormRange * range, double loudness);
+
+/* Number of values that passed the absolute gate */
+unsigned int loudnorm_range_get_count (const LoudnormRange * range);
+
+/* LRA in LU of the values in the window, 0.0 if none pass the gates.
+ * mean, if not NULL, gets the loudness of the mean energy of the values
+ * passing the gates in LUFS, -HUGE_VAL if there are none. */
+double loudnorm_range_get (const LoudnormRange * range, double *mean);
+
+/* Copies up to n of the latest values in the window to values, oldest
+ * first, and returns how many. They come back as the center of their
+ * bin, or -HUGE_VAL for a gated one, so pushing them into an empty range
+ * restores the window exactly. */
+unsigned int loudnorm_range_get_values (const LoudnormRange * range,
+    float *values, unsigned int n);
+
+size_t loudnorm_range_get_footprint (const LoudnormRange * range);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
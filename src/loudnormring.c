@@ -0,0 +1,145 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * Single-producer/single-consumer ring used to hand samples from the
+ * streaming thread to the analysis thread. head and tail only ever grow;
+ * the producer owns head, the consumer owns tail, and each side publishes
+ * its counter with release semantics after touching the data.
+ */
+
+#include "loudnormring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct _LoudnormRing
+{
+  uint8_t *data;
+  size_t capacity;
+  size_t mask;
+
+  /* keep the counters on separate cache lines, they bounce between cores */
+  size_t head __attribute__ ((aligned (64)));
+  size_t tail __attribute__ ((aligned (64)));
+};
+
+LoudnormRing *
+loudnorm_ring_new (size_t capacity)
+{
+  LoudnormRing *ring;
+  size_t size = 64;
+
+  while (size < capacity)
+    size <<= 1;
+
+  ring = aligned_alloc (64, sizeof (LoudnormRing));
+  if (ring == NULL)
+    return NULL;
+
+  ring->data = malloc (size);
+  if (ring->data == NULL) {
+    free (ring);
+    return NULL;
+  }
+  ring->capacity = size;
+  ring->mask = size - 1;
+  ring->head = 0;
+  ring->tail = 0;
+
+  return ring;
+}
+
+void
+loudnorm_ring_free (LoudnormRing * ring)
+{
+  if (ring == NULL)
+    return;
+
+  free (ring->data);
+  free (ring);
+}
+
+void
+loudnorm_ring_reset (LoudnormRing * ring)
+{
+  __atomic_store_n (&ring->head, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&ring->tail, 0, __ATOMIC_RELAXED);
+}
+
+size_t
+loudnorm_ring_get_capacity (LoudnormRing * ring)
+{
+  return ring->capacity;
+}
+
+size_t
+loudnorm_ring_write (LoudnormRing * ring, const void *data, size_t len,
+    size_t unit)
+{
+  size_t head = __atomic_load_n (&ring->head, __ATOMIC_RELAXED);
+  size_t tail = __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE);
+  size_t space = ring->capacity - (head - tail);
+  size_t offset, first;
+
+  if (len > space)
+    len = space;
+  len -= len % unit;
+  if (len == 0)
+    return 0;
+
+  offset = head & ring->mask;
+  first = ring->capacity - offset;
+  if (first > len)
+    first = len;
+
+  memcpy (ring->data + offset, data, first);
+  memcpy (ring->data, (const uint8_t *) data + first, len - first);
+
+  __atomic_store_n (&ring->head, head + len, __ATOMIC_RELEASE);
+
+  return len;
+}
+
+size_t
+loudnorm_ring_read (LoudnormRing * ring, void *data, size_t max, size_t unit)
+{
+  size_t tail = __atomic_load_n (&ring->tail, __ATOMIC_RELAXED);
+  size_t head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+  size_t len = head - tail;
+  size_t offset, first;
+
+  if (len > max)
+    len = max;
+  len -= len % unit;
+  if (len == 0)
+    return 0;
+
+  offset = tail & ring->mask;
+  first = ring->capacity - offset;
+  if (first > len)
+    first = len;
+
+  memcpy (data, ring->data + offset, first);
+  memcpy ((uint8_t *) data + first, ring->data, len - first);
+
+  __atomic_store_n (&ring->tail, tail + len, __ATOMIC_RELEASE);
+
+  return len;
+}
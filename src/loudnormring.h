@@ -0,0 +1,56 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_RING_H_
+#define _LOUDNORM_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Lock-free single-producer/single-consumer byte ring. One thread may call
+ * loudnorm_ring_write while another calls loudnorm_ring_read, without any
+ * further synchronization. Everything else needs both sides stopped. */
+typedef struct _LoudnormRing LoudnormRing;
+
+/* Capacity is rounded up to a power of two. */
+LoudnormRing *loudnorm_ring_new (size_t capacity);
+void loudnorm_ring_free (LoudnormRing * ring);
+void loudnorm_ring_reset (LoudnormRing * ring);
+
+size_t loudnorm_ring_get_capacity (LoudnormRing * ring);
+
+/* Copies whole units of len bytes from data into the ring, as many as fit.
+ * Returns the number of bytes written. */
+size_t loudnorm_ring_write (LoudnormRing * ring, const void *data, size_t len,
+    size_t unit);
+
+/* Copies at most max bytes, in whole units, out of the ring into data.
+ * Returns the number of bytes read. */
+size_t loudnorm_ring_read (LoudnormRing * ring, void *data, size_t max,
+    size_t unit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include "loudnormsmoother.h"
+
+#include <math.h>
+
+void
+loudnorm_smoother_init (LoudnormSmoother * smoother, double attack_ms,
+    double release_ms)
+{
+  smoother->attack_ms = attack_ms;
+  smoother->release_ms = release_ms;
+  loudnorm_smoother_reset (smoother);
+}
+
+void
+loudnorm_smoother_reset (LoudnormSmoother * smoother)
+{
+  smoother->value = 0.0;
+  smoother->primed = 0;
+}
+
+double
+loudnorm_smoother_push (LoudnormSmoother * smoother, double target,
+    double duration_ms)
+{
+  double tau;
+
+  if (!smoother->primed) {
+    smoother->value = target;
+    smoother->primed = 1;
+    return target;
+  }
+
+  tau = target < smoother->value ? smoother->attack_ms : smoother->release_ms;
+
+  /* the exact step response over duration_ms, so one long update and many
+   * short ones with the same target end up at the same value */
+  if (tau <= 0.0)
+    smoother->value = target;
+  else
+    smoother->value += (target - smoother->value) *
+        (1.0 - exp (-duration_ms / tau));
+
+  return smoother->value;
+}
+
+void
+loudnorm_ramp_init (LoudnormRamp * ramp, double value)
+{
+  ramp->value = value;
+  ramp->target = value;
+  ramp->step = 0.0;
+}
+
+void
+loudnorm_ramp_set (LoudnormRamp * ramp, double target, double ramp_ms)
+{
+  ramp->target = target;
+  if (ramp_ms > 0.0) {
+    ramp->step = fabs (target - ramp->value) / ramp_ms;
+  } else {
+    ramp->value = target;
+    ramp->step = 0.0;
+  }
+}
+
+double
+loudnorm_ramp_advance (LoudnormRamp * ramp, double duration_ms)
+{
+  double delta = ramp->step * duration_ms;
+
+  if (fabs (ramp->target - ramp->value) <= delta)
+    ramp->value = ramp->target;
+  else if (ramp->target > ramp->value)
+    ramp->value += delta;
+  else
+    ramp->value -= delta;
+
+  return ramp->value;
+}
@@ -0,0 +1,67 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_SMOOTHER_H_
+#define _LOUDNORM_SMOOTHER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One-pole gain smoother with separate attack and release times. The time
+ * constants are in milliseconds of audio, so the response does not depend
+ * on how the stream is cut into buffers. */
+typedef struct {
+  double value;
+  int primed;
+  double attack_ms;
+  double release_ms;
+} LoudnormSmoother;
+
+void loudnorm_smoother_init (LoudnormSmoother * smoother, double attack_ms,
+    double release_ms);
+void loudnorm_smoother_reset (LoudnormSmoother * smoother);
+
+/* Moves the smoothed value towards target for duration_ms of audio and
+ * returns it. Falling values use the attack time, rising ones the release
+ * time. The first push after a reset jumps straight to target. */
+double loudnorm_smoother_push (LoudnormSmoother * smoother, double target,
+    double duration_ms);
+
+/* Linear ramp for settings that change while audio flows, so a new value
+ * is reached over a fixed time of audio instead of at once */
+typedef struct {
+  double value;
+  double target;
+  double step;                  /* per ms */
+} LoudnormRamp;
+
+void loudnorm_ramp_init (LoudnormRamp * ramp, double value);
+
+/* Heads from the current value to target within ramp_ms, 0 jumps there */
+void loudnorm_ramp_set (LoudnormRamp * ramp, double target, double ramp_ms);
+
+/* Moves on by duration_ms of audio and returns the value */
+double loudnorm_ramp_advance (LoudnormRamp * ramp, double duration_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,331 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * True peak by 4x oversampling. The 48 taps of the BS.1770 interpolation
+ * filter split into four phases of 12, each producing one of the four
+ * output samples per input sample. A block is deinterleaved into one
+ * row per channel behind that channel's last 11 samples, so every phase
+ * is a plain 12 tap FIR over contiguous floats. The AVX2 and NEON
+ * kernels run it on 8 or 4 outputs at once with fused multiply-adds.
+ */
+
+#include "loudnormtruepeak.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LOUDNORM_TRUE_PEAK_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define LOUDNORM_TRUE_PEAK_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define TP_PHASES 4
+#define TP_TAPS 12
+#define TP_HISTORY LOUDNORM_TRUE_PEAK_HISTORY  /* TP_TAPS - 1 */
+
+/* frames deinterleaved at a time */
+#define TP_BLOCK 256
+
+static const float taps[TP_PHASES][TP_TAPS] = {
+  {0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f,
+      -0.0594482421875f, 0.1373291015625f, 0.9721679687500f,
+      -0.1022949218750f, 0.0476074218750f, -0.0266113281250f,
+      0.0148925781250f, -0.0083007812500f},
+  {-0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f,
+      -0.1665039062500f, 0.4650878906250f, 0.7797851562500f,
+      -0.2003173828125f, 0.1015625000000f, -0.0582275390625f,
+      0.0330810546875f, -0.0189208984375f},
+  {-0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f,
+      -0.2003173828125f, 0.7797851562500f, 0.4650878906250f,
+      -0.1665039062500f, 0.0891113281250f, -0.0517578125000f,
+      0.0292968750000f, -0.0291748046875f},
+  {-0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f,
+      -0.1022949218750f, 0.9721679687500f, 0.1373291015625f,
+      -0.0594482421875f, 0.0332031250000f, -0.0196533203125f,
+      0.0109863281250f, 0.0017089843750f}
+};
+
+/* Largest absolute output of all phases for the n samples following the
+ * TP_HISTORY ones x starts with */
+typedef float (*TruePeakFunc) (const float *x, size_t n);
+
+typedef struct {
+  const char *name;
+  TruePeakFunc max;
+} TruePeakImpl;
+
+static const TruePeakImpl *true_peak_impl = NULL;
+
+struct _LoudnormTruePeak
+{
+  unsigned int channels;
+  /* per channel TP_HISTORY + TP_BLOCK floats, the history in front */
+  float *rows;
+};
+
+static float
+true_peak_max_scalar (const float *x, size_t n)
+{
+  float peak = 0.0f;
+
+  for (size_t i = 0; i < n; i++) {
+    for (int p = 0; p < TP_PHASES; p++) {
+      float acc = 0.0f;
+
+      for (int k = 0; k < TP_TAPS; k++)
+        acc += taps[p][k] * x[i + k];
+      acc = fabsf (acc);
+      peak = acc > peak ? acc : peak;
+    }
+  }
+
+  return peak;
+}
+
+#ifdef LOUDNORM_TRUE_PEAK_X86
+__attribute__ ((target ("avx2,fma")))
+static float
+true_peak_max_avx2 (const float *x, size_t n)
+{
+  const __m256 sign = _mm256_set1_ps (-0.0f);
+  __m256 peak = _mm256_setzero_ps ();
+  float lanes[8], result;
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256 a0 = _mm256_setzero_ps (), a1 = _mm256_setzero_ps ();
+    __m256 a2 = _mm256_setzero_ps (), a3 = _mm256_setzero_ps ();
+
+    for (int k = 0; k < TP_TAPS; k++) {
+      __m256 v = _mm256_loadu_ps (x + i + k);
+
+      a0 = _mm256_fmadd_ps (_mm256_set1_ps (taps[0][k]), v, a0);
+      a1 = _mm256_fmadd_ps (_mm256_set1_ps (taps[1][k]), v, a1);
+      a2 = _mm256_fmadd_ps (_mm256_set1_ps (taps[2][k]), v, a2);
+      a3 = _mm256_fmadd_ps (_mm256_set1_ps (taps[3][k]), v, a3);
+    }
+
+    a0 = _mm256_max_ps (_mm256_andnot_ps (sign, a0),
+        _mm256_andnot_ps (sign, a1));
+    a2 = _mm256_max_ps (_mm256_andnot_ps (sign, a2),
+        _mm256_andnot_ps (sign, a3));
+    peak = _mm256_max_ps (peak, _mm256_max_ps (a0, a2));
+  }
+
+  _mm256_storeu_ps (lanes, peak);
+  result = i < n ? true_peak_max_scalar (x + i, n - i) : 0.0f;
+  for (int l = 0; l < 8; l++)
+    result = lanes[l] > result ? lanes[l] : result;
+
+  return result;
+}
+#endif
+
+#ifdef LOUDNORM_TRUE_PEAK_NEON
+static float
+true_peak_max_neon (const float *x, size_t n)
+{
+  float32x4_t peak = vdupq_n_f32 (0.0f);
+  float result;
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t a0 = vdupq_n_f32 (0.0f), a1 = vdupq_n_f32 (0.0f);
+    float32x4_t a2 = vdupq_n_f32 (0.0f), a3 = vdupq_n_f32 (0.0f);
+
+    for (int k = 0; k < TP_TAPS; k++) {
+      float32x4_t v = vld1q_f32 (x + i + k);
+
+      a0 = vfmaq_n_f32 (a0, v, taps[0][k]);
+      a1 = vfmaq_n_f32 (a1, v, taps[1][k]);
+      a2 = vfmaq_n_f32 (a2, v, taps[2][k]);
+      a3 = vfmaq_n_f32 (a3, v, taps[3][k]);
+    }
+
+    a0 = vmaxq_f32 (vabsq_f32 (a0), vabsq_f32 (a1));
+    a2 = vmaxq_f32 (vabsq_f32 (a2), vabsq_f32 (a3));
+    peak = vmaxq_f32 (peak, vmaxq_f32 (a0, a2));
+  }
+
+  result = i < n ? true_peak_max_scalar (x + i, n - i) : 0.0f;
+  return fmaxf (result, vmaxvq_f32 (peak));
+}
+#endif
+
+static const TruePeakImpl true_peak_impl_scalar =
+    { "scalar", true_peak_max_scalar };
+#ifdef LOUDNORM_TRUE_PEAK_X86
+static const TruePeakImpl true_peak_impl_avx2 =
+    { "avx2", true_peak_max_avx2 };
+#endif
+#ifdef LOUDNORM_TRUE_PEAK_NEON
+static const TruePeakImpl true_peak_impl_neon =
+    { "neon", true_peak_max_neon };
+#endif
+
+static const TruePeakImpl *
+get_impl (void)
+{
+  const TruePeakImpl *impl =
+      __atomic_load_n (&true_peak_impl, __ATOMIC_ACQUIRE);
+
+  if (impl != NULL)
+    return impl;
+
+  impl = &true_peak_impl_scalar;
+#ifdef LOUDNORM_TRUE_PEAK_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+    impl = &true_peak_impl_avx2;
+#endif
+#ifdef LOUDNORM_TRUE_PEAK_NEON
+  impl = &true_peak_impl_neon;
+#endif
+
+  /* every caller picks the same kernel, so racing here is harmless */
+  __atomic_store_n (&true_peak_impl, impl, __ATOMIC_RELEASE);
+  return impl;
+}
+
+const char *
+loudnorm_true_peak_get_impl_name (void)
+{
+  return get_impl ()->name;
+}
+
+double
+loudnorm_true_peak_get_bound (void)
+{
+  double bound = 0.0;
+
+  for (int p = 0; p < TP_PHASES; p++) {
+    double sum = 0.0;
+
+    for (int k = 0; k < TP_TAPS; k++)
+      sum += fabs (taps[p][k]);
+    bound = sum > bound ? sum : bound;
+  }
+
+  return bound;
+}
+
+LoudnormTruePeak *
+loudnorm_true_peak_new (unsigned int channels)
+{
+  LoudnormTruePeak *tp;
+
+  if (channels == 0)
+    return NULL;
+
+  tp = calloc (1, sizeof (LoudnormTruePeak));
+  if (tp == NULL)
+    return NULL;
+
+  tp->channels = channels;
+  tp->rows = calloc ((size_t) channels * (TP_HISTORY + TP_BLOCK),
+      sizeof (float));
+  if (tp->rows == NULL) {
+    loudnorm_true_peak_free (tp);
+    return NULL;
+  }
+
+  get_impl ();
+
+  return tp;
+}
+
+void
+loudnorm_true_peak_free (LoudnormTruePeak * tp)
+{
+  if (tp == NULL)
+    return;
+
+  free (tp->rows);
+  free (tp);
+}
+
+void
+loudnorm_true_peak_reset (LoudnormTruePeak * tp)
+{
+  memset (tp->rows, 0,
+      (size_t) tp->channels * (TP_HISTORY + TP_BLOCK) * sizeof (float));
+}
+
+double
+loudnorm_true_peak_process (LoudnormTruePeak * tp, const float *data,
+    size_t frames)
+{
+  TruePeakFunc max = get_impl ()->max;
+  unsigned int channels = tp->channels;
+  float peak = 0.0f;
+
+  while (frames > 0) {
+    size_t n = frames < TP_BLOCK ? frames : TP_BLOCK;
+
+    for (unsigned int c = 0; c < channels; c++) {
+      float *row = tp->rows + (size_t) c * (TP_HISTORY + TP_BLOCK);
+      float p;
+
+      for (size_t f = 0; f < n; f++)
+        row[TP_HISTORY + f] = data[f * channels + c];
+
+      p = max (row, n);
+      peak = p > peak ? p : peak;
+
+      memmove (row, row + n, TP_HISTORY * sizeof (float));
+    }
+
+    data += n * channels;
+    frames -= n;
+  }
+
+  return peak;
+}
+
+void
+loudnorm_true_peak_skip (LoudnormTruePeak * tp, const float *data,
+    size_t frames)
+{
+  unsigned int channels = tp->channels;
+  size_t n = frames < TP_HISTORY ? frames : TP_HISTORY;
+
+  data += (frames - n) * channels;
+
+  for (unsigned int c = 0; c < channels; c++) {
+    float *row = tp->rows + (size_t) c * (TP_HISTORY + TP_BLOCK);
+
+    memmove (row, row + n, (TP_HISTORY - n) * sizeof (float));
+    for (size_t f = 0; f < n; f++)
+      row[TP_HISTORY - n + f] = data[f * channels + c];
+  }
+}
+
+size_t
+loudnorm_true_peak_get_footprint (const LoudnormTruePeak * tp)
+{
+  return sizeof (LoudnormTruePeak) +
+      (size_t) tp->channels * (TP_HISTORY + TP_BLOCK) * sizeof (float);
+}
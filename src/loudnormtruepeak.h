@@ -0,0 +1,69 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _LOUDNORM_TRUE_PEAK_H_
+#define _LOUDNORM_TRUE_PEAK_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* True-peak meter after ITU-R BS.1770-4 Annex 2: interleaved float
+ * frames are oversampled 4x with a 48 tap polyphase FIR and the largest
+ * absolute value is reported. The filter keeps its history across
+ * blocks. */
+typedef struct _LoudnormTruePeak LoudnormTruePeak;
+
+/* Returns NULL on failure */
+LoudnormTruePeak *loudnorm_true_peak_new (unsigned int channels);
+void loudnorm_true_peak_free (LoudnormTruePeak * tp);
+
+/* Clears the history */
+void loudnorm_true_peak_reset (LoudnormTruePeak * tp);
+
+/* Name of the selected kernel ("scalar", "avx2" or "neon") */
+const char *loudnorm_true_peak_get_impl_name (void);
+
+/* Most the oversampled signal can exceed the sample peak by, as a
+ * factor: the largest sum of absolute taps of a phase, about 6.1 dB */
+double loudnorm_true_peak_get_bound (void);
+
+/* Largest absolute value of the oversampled frames, 1.0 being full
+ * scale */
+double loudnorm_true_peak_process (LoudnormTruePeak * tp, const float *data,
+    size_t frames);
+
+/* Only takes frames into the history, for blocks known to be clear of
+ * the ceiling. Cheaper than process, as only the last frames count. */
+void loudnorm_true_peak_skip (LoudnormTruePeak * tp, const float *data,
+    size_t frames);
+
+/* Frames skip needs to see at most */
+#define LOUDNORM_TRUE_PEAK_HISTORY 11
+
+/* Bytes held by the meter */
+size_t loudnorm_true_peak_get_footprint (const LoudnormTruePeak * tp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,275 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+
+/*
+ * Checks the in-tree meter against libebur128 on synthetic signals.
+ *
+ * Every signal is measured by both at several rates, channel counts and
+ * sample formats, and the integrated loudness, loudness range and final
+ * short-term loudness have to agree within the tolerances below. The
+ * signals cover steady tones in and below the K-weighting shelf, tones
+ * broken up by digital silence and by passages under the relative gate,
+ * and level steps that spread the loudness range. Rates the meter
+ * cannot measure at have to be refused.
+ *
+ *   make check
+ */
+
+#include <ebur128.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/loudnormmeter.h"
+
+#define SECONDS 20
+
+#define INTEGRATED_TOLERANCE 0.005
+#define RANGE_TOLERANCE 0.1
+#define SHORTTERM_TOLERANCE 0.01
+
+typedef enum {
+  FORMAT_S16,
+  FORMAT_S32,
+  FORMAT_F32
+} Format;
+
+static const char *format_names[] = { "s16", "s32", "f32" };
+static const size_t format_sizes[] = { 2, 4, 4 };
+
+typedef enum {
+  SIGNAL_TONE,
+  SIGNAL_LOW_TONE,
+  SIGNAL_GATED,
+  SIGNAL_STEPS,
+  SIGNAL_SILENCE
+} Signal;
+
+static const char *signal_names[] =
+    { "tone", "low-tone", "gated", "steps", "silence" };
+
+static const unsigned int rates[] = { 8000, 44100, 48000, 96000 };
+
+/* rates and decimation factors below LOUDNORM_METER_MIN_RATE */
+static const unsigned int refused_rates[][2] =
+    { {0, 1}, {1, 1}, {4, 1}, {9, 1}, {7999, 1}, {48000, 7} };
+static const unsigned int channel_counts[] = { 1, 2, 6 };
+
+static double
+db_to_amplitude (double db)
+{
+  return pow (10.0, db / 20.0);
+}
+
+/* Amplitude of the signal at time t, the same on every channel */
+static double
+signal_value (Signal signal, double t)
+{
+  switch (signal) {
+    case SIGNAL_TONE:
+      return db_to_amplitude (-20.0) * sin (2 * M_PI * 997.0 * t);
+    case SIGNAL_LOW_TONE:
+      return db_to_amplitude (-6.0) * sin (2 * M_PI * 45.0 * t);
+    case SIGNAL_GATED:{
+      /* 4 s of tone, 3 s of nothing, then 3 s 30 dB down, which the
+       * absolute and the relative gate have to drop */
+      double phase = fmod (t, 10.0);
+      double level = phase < 4.0 ? -12.0 : phase < 7.0 ? -200.0 : -42.0;
+
+      return phase >= 4.0 && phase < 7.0 ? 0.0 :
+          db_to_amplitude (level) * sin (2 * M_PI * 1000.0 * t);
+    }
+    case SIGNAL_STEPS:{
+      /* 5 s steps of 6 dB from -36 to -12 dBFS and back down */
+      static const double levels[] = { -36.0, -30.0, -24.0, -18.0,
+        -12.0, -18.0, -24.0, -30.0
+      };
+      int step = (int) (t / 5.0) % 8;
+
+      return db_to_amplitude (levels[step]) * sin (2 * M_PI * 500.0 * t);
+    }
+    case SIGNAL_SILENCE:
+      return 0.0;
+  }
+  return 0.0;
+}
+
+static void *
+generate (Signal signal, Format format, unsigned int rate,
+    unsigned int channels, size_t frames)
+{
+  unsigned char *out = malloc (frames * channels * format_sizes[format]);
+
+  for (size_t i = 0; i < frames; i++) {
+    double v = signal_value (signal, (double) i / rate);
+
+    for (unsigned int c = 0; c < channels; c++) {
+      size_t n = i * channels + c;
+
+      switch (format) {
+        case FORMAT_S16:
+          ((int16_t *) out)[n] = (int16_t) lrint (v * 32767.0);
+          break;
+        case FORMAT_S32:
+          ((int32_t *) out)[n] = (int32_t) lrint (v * 2147483647.0);
+          break;
+        case FORMAT_F32:
+          ((float *) out)[n] = (float) v;
+          break;
+      }
+    }
+  }
+  return out;
+}
+
+/* libebur128 leaves the fourth channel (LFE) out and weighs the fifth
+ * and sixth (surround) by 1.41, the meter has to be told */
+static void
+set_channel_weights (LoudnormMeter * meter, unsigned int channels)
+{
+  for (unsigned int c = 0; c < channels; c++) {
+    if (c == 3)
+      loudnorm_meter_set_channel_weight (meter, c, 0.0);
+    else if (c == 4 || c == 5)
+      loudnorm_meter_set_channel_weight (meter, c, 1.41);
+  }
+}
+
+/* Both are -HUGE_VAL for silence, which compares equal */
+static int
+within (double value, double expected, double tolerance)
+{
+  if (isinf (value) || isinf (expected))
+    return value == expected;
+  return fabs (value - expected) <= tolerance;
+}
+
+static int
+check (Signal signal, Format format, unsigned int rate,
+    unsigned int channels)
+{
+  size_t frames = (size_t) SECONDS * rate, step = rate / 10;
+  size_t bpf = format_sizes[format] * channels;
+  unsigned char *data = generate (signal, format, rate, channels, frames);
+  LoudnormMeter *meter = loudnorm_meter_new (rate, channels);
+  ebur128_state *st = ebur128_init (channels, rate,
+      EBUR128_MODE_I | EBUR128_MODE_LRA);
+  double integrated, range, shortterm;
+  double meter_integrated, meter_range, meter_shortterm;
+  int ok;
+
+  if (meter == NULL || st == NULL || !loudnorm_meter_enable_gating (meter)) {
+    fprintf (stderr, "could not create the meters\n");
+    exit (1);
+  }
+  set_channel_weights (meter, channels);
+
+  /* odd sized buffers, so blocks do not line up with them */
+  for (size_t pos = 0; pos < frames; pos += step + 7) {
+    size_t n = pos + step + 7 <= frames ? step + 7 : frames - pos;
+
+    switch (format) {
+      case FORMAT_S16:
+        loudnorm_meter_add_s16 (meter, (int16_t *) (data + pos * bpf), n);
+        ebur128_add_frames_short (st, (short *) (data + pos * bpf), n);
+        break;
+      case FORMAT_S32:
+        loudnorm_meter_add_s32 (meter, (int32_t *) (data + pos * bpf), n);
+        ebur128_add_frames_int (st, (int *) (data + pos * bpf), n);
+        break;
+      case FORMAT_F32:
+        loudnorm_meter_add_f32 (meter, (float *) (data + pos * bpf), n);
+        ebur128_add_frames_float (st, (float *) (data + pos * bpf), n);
+        break;
+    }
+  }
+
+  ebur128_loudness_global (st, &integrated);
+  ebur128_loudness_range (st, &range);
+  ebur128_loudness_shortterm (st, &shortterm);
+  meter_integrated = loudnorm_meter_integrated (meter);
+  meter_range = loudnorm_meter_range (meter);
+  meter_shortterm = loudnorm_meter_shortterm (meter);
+
+  ok = within (meter_integrated, integrated, INTEGRATED_TOLERANCE) &&
+      within (meter_range, range, RANGE_TOLERANCE) &&
+      within (meter_shortterm, shortterm, SHORTTERM_TOLERANCE);
+
+  printf ("%s %-8s %-3s %5u Hz %u ch: integrated %+.3f LU, LRA %+.3f LU, "
+      "short-term %+.3f LU\n", ok ? "ok  " : "FAIL", signal_names[signal],
+      format_names[format], rate, channels,
+      isinf (integrated) ? 0.0 : meter_integrated - integrated,
+      meter_range - range,
+      isinf (shortterm) ? 0.0 : meter_shortterm - shortterm);
+  if (!ok)
+    printf ("     meter %.3f LUFS %.3f LU %.3f LUFS, "
+        "ebur128 %.3f LUFS %.3f LU %.3f LUFS\n", meter_integrated,
+        meter_range, meter_shortterm, integrated, range, shortterm);
+
+  loudnorm_meter_free (meter);
+  ebur128_destroy (&st);
+  free (data);
+  return ok;
+}
+
+static int
+check_refused (unsigned int rate, unsigned int factor)
+{
+  LoudnormMeter *meter = loudnorm_meter_new_decimated (rate, 1, factor);
+  int ok = meter == NULL;
+
+  printf ("%s refused  %5u Hz / %u\n", ok ? "ok  " : "FAIL", rate, factor);
+  loudnorm_meter_free (meter);
+  return ok;
+}
+
+int
+main (void)
+{
+  unsigned int failed = 0, total = 0;
+  int major, minor, patch;
+
+  ebur128_get_version (&major, &minor, &patch);
+  printf ("comparing with libebur128 %d.%d.%d\n", major, minor, patch);
+
+  for (int s = SIGNAL_TONE; s <= SIGNAL_SILENCE; s++) {
+    for (size_t r = 0; r < sizeof (rates) / sizeof (rates[0]); r++) {
+      for (size_t c = 0; c < sizeof (channel_counts) /
+          sizeof (channel_counts[0]); c++) {
+        for (int f = FORMAT_S16; f <= FORMAT_F32; f++) {
+          if (!check (s, f, rates[r], channel_counts[c]))
+            failed++;
+          total++;
+        }
+      }
+    }
+  }
+
+  for (size_t r = 0; r < sizeof (refused_rates) / sizeof (refused_rates[0]);
+      r++) {
+    if (!check_refused (refused_rates[r][0], refused_rates[r][1]))
+      failed++;
+    total++;
+  }
+
+  printf ("%u of %u checks passed\n", total - failed, total);
+  return failed > 0;
+}
@@ -0,0 +1,231 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+
+/*
+ * Runs loudnormmux from the plugin in build.
+ *
+ * Every pad gets the same tone and its own targets, set through the
+ * child proxy of the element as a launch line would, and every output
+ * channel has to end up at the target of its pad. A mux that takes its
+ * processors from the pool after a loudnorm element with other settings
+ * has to normalize the same way.
+ *
+ *   make check
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <math.h>
+
+#define RATE 48000
+#define SECONDS 20
+/* frames of a pushed buffer, 100 ms */
+#define BLOCK 4800
+/* the level of the output is taken over the last seconds */
+#define LEVEL_SECONDS 2
+
+/* a 997 Hz tone at -20 dBFS, -23 LUFS on one channel */
+#define TONE_AMPLITUDE 0.1
+#define TONE_FREQ 997.0
+
+#define DEFAULT_TARGET_LOUDNESS -23.0
+#define LEVEL_TOLERANCE 1.0
+
+#define SINK_CAPS "audio/x-raw, format = (string) F32LE, " \
+    "rate = (int) 48000, channels = (int) 1, " \
+    "layout = (string) interleaved"
+
+static GstBuffer *
+tone_buffer (guint64 offset, guint frames)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL,
+      frames * sizeof (gfloat), NULL);
+  GstMapInfo map;
+  gfloat *data;
+
+  fail_unless (gst_buffer_map (buffer, &map, GST_MAP_WRITE));
+  data = (gfloat *) map.data;
+  for (guint i = 0; i < frames; i++)
+    data[i] = TONE_AMPLITUDE * sin (2 * G_PI * TONE_FREQ * (offset + i) /
+        RATE);
+  gst_buffer_unmap (buffer, &map);
+
+  GST_BUFFER_PTS (buffer) = gst_util_uint64_scale (offset, GST_SECOND, RATE);
+  GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale (frames, GST_SECOND,
+      RATE);
+  GST_BUFFER_OFFSET (buffer) = offset;
+  GST_BUFFER_OFFSET_END (buffer) = offset + frames;
+
+  return buffer;
+}
+
+/* Sums the squares of the channels over the frames of buffer from frame
+ * first on, returns the frames it held */
+static guint64
+add_levels (GstBuffer * buffer, guint channels, guint64 position,
+    guint64 first, gdouble * sums)
+{
+  GstMapInfo map;
+  const gfloat *data;
+  guint64 frames;
+
+  fail_unless (gst_buffer_map (buffer, &map, GST_MAP_READ));
+  data = (const gfloat *) map.data;
+  frames = map.size / (channels * sizeof (gfloat));
+  for (guint64 i = 0; i < frames; i++) {
+    if (position + i < first)
+      continue;
+    for (guint c = 0; c < channels; c++)
+      sums[c] += data[i * channels + c] * data[i * channels + c];
+  }
+  gst_buffer_unmap (buffer, &map);
+
+  return frames;
+}
+
+/* Pushes SECONDS of the tone into n_pads pads of a new mux, with the
+ * target loudness of each pad in targets or NAN to keep the default,
+ * and returns the level of each output channel in dB */
+static void
+run_mux (const gdouble * targets, guint n_pads, gdouble * levels)
+{
+  GstHarness *h[n_pads];
+  gdouble sums[n_pads];
+  guint64 total = (guint64) SECONDS * RATE;
+  guint64 first = total - (guint64) LEVEL_SECONDS * RATE;
+  guint64 position = 0;
+  GstCaps *caps;
+  gint channels = 0;
+
+  h[0] = gst_harness_new_with_padnames ("loudnormmux", "sink_0", "src");
+  for (guint i = 1; i < n_pads; i++) {
+    gchar *name = g_strdup_printf ("sink_%u", i);
+
+    h[i] = gst_harness_new_with_element (h[0]->element, name, NULL);
+    g_free (name);
+  }
+
+  for (guint i = 0; i < n_pads; i++) {
+    gchar *name = g_strdup_printf ("sink_%u::target-loudness", i);
+
+    if (!isnan (targets[i]))
+      gst_child_proxy_set (GST_CHILD_PROXY (h[0]->element), name,
+          (gfloat) targets[i], NULL);
+    g_free (name);
+
+    /* the mux waits for every pad instead of the clock */
+    gst_harness_set_live (h[i], FALSE);
+    gst_harness_set_src_caps_str (h[i], SINK_CAPS);
+    sums[i] = 0.0;
+  }
+
+  /* a full pad takes the next buffer once the others caught up */
+  for (guint64 offset = 0; offset < total; offset += BLOCK) {
+    for (guint i = 0; i < n_pads; i++)
+      fail_unless_equals_int (gst_harness_push (h[i],
+              tone_buffer (offset, BLOCK)), GST_FLOW_OK);
+  }
+
+  while (position < total) {
+    GstBuffer *buffer = gst_harness_pull (h[0]);
+
+    fail_unless (buffer != NULL);
+    if (channels == 0) {
+      caps = gst_pad_get_current_caps (h[0]->sinkpad);
+      fail_unless (caps != NULL);
+      fail_unless (gst_structure_get_int (gst_caps_get_structure (caps, 0),
+              "channels", &channels));
+      fail_unless_equals_int (channels, n_pads);
+      gst_caps_unref (caps);
+    }
+    position += add_levels (buffer, channels, position, first, sums);
+    gst_buffer_unref (buffer);
+  }
+
+  for (guint i = 0; i < n_pads; i++) {
+    levels[i] = 10.0 * log10 (sums[i] / (total - first));
+    GST_INFO ("channel %u at %.2f dB", i, levels[i]);
+  }
+
+  for (guint i = n_pads; i-- > 1;)
+    gst_harness_teardown (h[i]);
+  gst_harness_teardown (h[0]);
+}
+
+static void
+assert_level (gdouble level, gdouble target)
+{
+  fail_unless (fabs (level - target) < LEVEL_TOLERANCE,
+      "level %.2f dB, target %.2f LUFS", level, target);
+}
+
+GST_START_TEST (test_pad_targets)
+{
+  const gdouble targets[] = { -16.0, -30.0, NAN };
+  gdouble levels[G_N_ELEMENTS (targets)];
+
+  run_mux (targets, G_N_ELEMENTS (targets), levels);
+
+  assert_level (levels[0], -16.0);
+  assert_level (levels[1], -30.0);
+  assert_level (levels[2], DEFAULT_TARGET_LOUDNESS);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_pooled_settings)
+{
+  const gdouble targets[] = { -16.0, NAN };
+  gdouble levels[G_N_ELEMENTS (targets)];
+  GstHarness *h;
+
+  /* the tone is silence to this one, its processor goes back to the pool
+   * on teardown */
+  h = gst_harness_new ("loudnorm");
+  g_object_set (h->element, "target-loudness", -30.0f, "silent-threshold",
+      -10.0f, "attack-time", 5000.0f, NULL);
+  gst_harness_set_src_caps_str (h, SINK_CAPS);
+  for (guint64 offset = 0; offset < RATE; offset += BLOCK)
+    fail_unless_equals_int (gst_harness_push (h, tone_buffer (offset,
+                BLOCK)), GST_FLOW_OK);
+  gst_harness_teardown (h);
+
+  run_mux (targets, G_N_ELEMENTS (targets), levels);
+
+  assert_level (levels[0], -16.0);
+  assert_level (levels[1], DEFAULT_TARGET_LOUDNESS);
+}
+
+GST_END_TEST;
+
+static Suite *
+loudnormmux_suite (void)
+{
+  Suite *s = suite_create ("loudnormmux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_pad_targets);
+  tcase_add_test (tc_chain, test_pooled_settings);
+
+  return s;
+}
+
+GST_CHECK_MAIN (loudnormmux);
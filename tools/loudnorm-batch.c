@@ -0,0 +1,395 @@
+/* GStreamer
+ * Copyright (C) 2024 Cradlewise <sivaram@cradlewise.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/*
+ * Normalizes WAV files without a pipeline, with the same processor the
+ * element wraps.
+ *
+ * Every file is mapped into memory and measured in one pass over the
+ * mapping: the integrated loudness by default, after which a single
+ * static gain is written into a mapping of the output, like the analyze
+ * and apply modes of the element. -r runs the realtime gain instead, in
+ * 100 ms blocks, holding the loudness range to -l like target-lra of the
+ * element. Files are spread over -j threads, one file per thread
+ * at a time, so a large archive keeps every core busy.
+ *
+ *   make batch
+ *   build/loudnorm-batch -t -16 -j 8 -o normalized/ a.wav b.wav c.wav
+ *
+ * Reads and writes 16 and 32 bit integer and 32 bit float PCM, plain or
+ * WAVE_FORMAT_EXTENSIBLE, on little-endian hosts. Everything outside
+ * the data chunk is copied as it is.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/loudnormmeter.h"
+#include "../src/loudnormprocessor.h"
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+/* the defaults of the element */
+#define DEFAULT_TARGET_LOUDNESS -23.0
+#define DEFAULT_TARGET_LRA 7.0
+
+/* channel mask bits of the LFE and surround speakers */
+#define SPEAKER_LOW_FREQUENCY 0x8
+#define SPEAKER_SURROUND 0x630
+
+typedef struct {
+  double target;
+  double target_lra;
+  int realtime;
+  const char *output_dir;
+} Options;
+
+typedef struct {
+  LoudnormFormat format;
+  unsigned int rate;
+  unsigned int channels;
+  unsigned int bpf;
+  uint32_t channel_mask;
+  size_t data_offset;
+  size_t frames;
+} WavInfo;
+
+typedef struct {
+  const Options *options;
+  char **files;
+  int n_files;
+  int next;
+  int failed;
+} Batch;
+
+static uint32_t
+read_le16 (const uint8_t * p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static uint32_t
+read_le32 (const uint8_t * p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+/* Finds the format and the data chunk, returns an error message or NULL */
+static const char *
+wav_parse (const uint8_t * map, size_t size, WavInfo * info)
+{
+  size_t pos = 12, data_size = 0;
+  int have_format = 0, have_data = 0;
+
+  memset (info, 0, sizeof (WavInfo));
+
+  if (size < 12 || memcmp (map, "RIFF", 4) || memcmp (map + 8, "WAVE", 4))
+    return "not a WAV file";
+
+  while (pos + 8 <= size && !have_data) {
+    const uint8_t *chunk = map + pos;
+    size_t len = read_le32 (chunk + 4);
+
+    if (memcmp (chunk, "fmt ", 4) == 0) {
+      unsigned int tag, bits;
+
+      if (len < 16 || pos + 8 + len > size)
+        return "truncated fmt chunk";
+
+      tag = read_le16 (chunk + 8);
+      info->channels = read_le16 (chunk + 10);
+      info->rate = read_le32 (chunk + 12);
+      info->bpf = read_le16 (chunk + 20);
+      bits = read_le16 (chunk + 22);
+
+      if (tag == WAVE_FORMAT_EXTENSIBLE) {
+        if (len < 40)
+          return "truncated fmt chunk";
+        info->channel_mask = read_le32 (chunk + 28);
+        tag = read_le16 (chunk + 32);
+      }
+
+      if (tag == WAVE_FORMAT_PCM && bits == 16)
+        info->format = LOUDNORM_FORMAT_S16;
+      else if (tag == WAVE_FORMAT_PCM && bits == 32)
+        info->format = LOUDNORM_FORMAT_S32;
+      else if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32)
+        info->format = LOUDNORM_FORMAT_F32;
+      else
+        return "unsupported sample format";
+
+      if (info->channels == 0 || info->rate == 0 ||
+          info->bpf != info->channels * bits / 8)
+        return "invalid fmt chunk";
+      have_format = 1;
+    } else if (memcmp (chunk, "data", 4) == 0) {
+      info->data_offset = pos + 8;
+      /* streamed files leave the size open, take what is there */
+      data_size = len < size - info->data_offset ? len :
+          size - info->data_offset;
+      have_data = 1;
+    }
+
+    pos += 8 + len + (len & 1);
+  }
+
+  if (!have_format || !have_data)
+    return "no fmt or data chunk";
+
+  info->frames = data_size / info->bpf;
+  return NULL;
+}
+
+/* BS.1770 weights from the channel mask, the LFE is left out */
+static void
+set_channel_weights (LoudnormMeter * meter, const WavInfo * info)
+{
+  uint32_t mask = info->channel_mask;
+  unsigned int c = 0;
+
+  for (uint32_t bit = 1; bit && c < info->channels; bit <<= 1) {
+    if (!(mask & bit))
+      continue;
+    if (bit & SPEAKER_LOW_FREQUENCY)
+      loudnorm_meter_set_channel_weight (meter, c, 0.0);
+    else if (bit & SPEAKER_SURROUND)
+      loudnorm_meter_set_channel_weight (meter, c, 1.41);
+    c++;
+  }
+}
+
+static void *
+map_file (int fd, size_t size, int prot)
+{
+  void *map = mmap (NULL, size, prot, MAP_SHARED, fd, 0);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  madvise (map, size, MADV_SEQUENTIAL);
+  return map;
+}
+
+/* Writes the normalized copy of path into the output directory */
+static int
+normalize_file (const Options * options, const char *path)
+{
+  const char *name = strrchr (path, '/') ? strrchr (path, '/') + 1 : path;
+  char *out_path = NULL;
+  const char *error = NULL;
+  uint8_t *in = NULL, *out = NULL;
+  int in_fd, out_fd = -1;
+  struct stat in_st, out_st;
+  LoudnormProcessor *processor = NULL;
+  WavInfo info;
+  size_t size = 0, clipped = 0, end;
+  double loudness = -HUGE_VAL, gain = 0.0;
+
+  in_fd = open (path, O_RDONLY);
+  if (in_fd < 0 || fstat (in_fd, &in_st) < 0) {
+    error = strerror (errno);
+    goto done;
+  }
+  size = in_st.st_size;
+
+  if (size == 0 || (in = map_file (in_fd, size, PROT_READ)) == NULL) {
+    error = size == 0 ? "empty file" : strerror (errno);
+    goto done;
+  }
+
+  if ((error = wav_parse (in, size, &info)) != NULL)
+    goto done;
+
+  processor = loudnorm_processor_new (info.format, info.rate, info.channels,
+      1);
+  if (processor == NULL) {
+    error = "failed to allocate the processor";
+    goto done;
+  }
+  loudnorm_processor_set_target (processor, options->target,
+      options->target_lra);
+  set_channel_weights (loudnorm_processor_get_meter (processor), &info);
+
+  if (!options->realtime) {
+    LoudnormMeter *meter = loudnorm_processor_get_meter (processor);
+
+    if (!loudnorm_meter_enable_gating (meter)) {
+      error = "failed to allocate the gating histograms";
+      goto done;
+    }
+    loudnorm_processor_add (processor, in + info.data_offset, info.frames);
+    loudness = loudnorm_meter_integrated (meter);
+    if (isfinite (loudness))
+      gain = options->target - loudness;
+  }
+
+  out_path = malloc (strlen (options->output_dir) + strlen (name) + 2);
+  if (out_path == NULL) {
+    error = strerror (ENOMEM);
+    goto done;
+  }
+  sprintf (out_path, "%s/%s", options->output_dir, name);
+
+  if (stat (out_path, &out_st) == 0 && out_st.st_dev == in_st.st_dev &&
+      out_st.st_ino == in_st.st_ino) {
+    error = "refusing to overwrite the input";
+    goto done;
+  }
+
+  out_fd = open (out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0 || ftruncate (out_fd, size) < 0 ||
+      (out = map_file (out_fd, size, PROT_READ | PROT_WRITE)) == NULL) {
+    error = strerror (errno);
+    goto done;
+  }
+
+  /* headers, trailing chunks and a partial last frame stay as they are */
+  end = info.data_offset + info.frames * info.bpf;
+  memcpy (out, in, info.data_offset);
+  memcpy (out + end, in + end, size - end);
+
+  if (options->realtime) {
+    size_t block = (info.rate + 5) / 10;
+
+    for (size_t pos = 0; pos < info.frames; pos += block) {
+      size_t n = info.frames - pos < block ? info.frames - pos : block;
+      size_t offset = info.data_offset + pos * info.bpf;
+
+      clipped += loudnorm_processor_process (processor, in + offset,
+          out + offset, n, &gain);
+    }
+  } else {
+    clipped = loudnorm_processor_apply (processor, in + info.data_offset,
+        out + info.data_offset, info.frames, gain);
+  }
+
+  if (options->realtime)
+    printf ("%s: realtime, last gain %+.2f dB, %zu clipped\n", out_path,
+        gain, clipped);
+  else
+    printf ("%s: %.2f LUFS, %+.2f dB, %zu clipped\n", out_path, loudness,
+        gain, clipped);
+
+done:
+  if (error)
+    fprintf (stderr, "%s: %s\n", path, error);
+
+  loudnorm_processor_free (processor);
+  if (out)
+    munmap (out, size);
+  if (in)
+    munmap (in, size);
+  if (out_fd >= 0)
+    close (out_fd);
+  if (in_fd >= 0)
+    close (in_fd);
+  free (out_path);
+
+  return error ? -1 : 0;
+}
+
+static void *
+worker (void *data)
+{
+  Batch *batch = data;
+  int i;
+
+  while ((i = __atomic_fetch_add (&batch->next, 1, __ATOMIC_RELAXED)) <
+      batch->n_files) {
+    if (normalize_file (batch->options, batch->files[i]) < 0)
+      __atomic_fetch_add (&batch->failed, 1, __ATOMIC_RELAXED);
+  }
+
+  return NULL;
+}
+
+static void
+usage (const char *prog)
+{
+  fprintf (stderr, "usage: %s [-t target-loudness] [-r [-l target-lra]] "
+      "[-j jobs] -o output-dir file.wav...\n", prog);
+  exit (1);
+}
+
+int
+main (int argc, char **argv)
+{
+  Options options = { DEFAULT_TARGET_LOUDNESS, DEFAULT_TARGET_LRA, 0, NULL };
+  long jobs = sysconf (_SC_NPROCESSORS_ONLN);
+  pthread_t *threads;
+  Batch batch = { 0 };
+  int opt, started = 0;
+
+  while ((opt = getopt (argc, argv, "t:l:rj:o:h")) != -1) {
+    switch (opt) {
+      case 't':
+        options.target = atof (optarg);
+        break;
+      case 'l':
+        options.target_lra = atof (optarg);
+        break;
+      case 'r':
+        options.realtime = 1;
+        break;
+      case 'j':
+        jobs = atol (optarg);
+        break;
+      case 'o':
+        options.output_dir = optarg;
+        break;
+      default:
+        usage (argv[0]);
+    }
+  }
+
+  if (options.output_dir == NULL || optind >= argc || jobs < 1)
+    usage (argv[0]);
+
+  batch.options = &options;
+  batch.files = argv + optind;
+  batch.n_files = argc - optind;
+  if (jobs > batch.n_files)
+    jobs = batch.n_files;
+
+  /* the main thread is one of the jobs */
+  threads = calloc (jobs, sizeof (pthread_t));
+  for (long i = 1; i < jobs; i++) {
+    if (pthread_create (&threads[i], NULL, worker, &batch) != 0)
+      break;
+    started++;
+  }
+  worker (&batch);
+  for (int i = 1; i <= started; i++)
+    pthread_join (threads[i], NULL);
+  free (threads);
+
+  return batch.failed ? 1 : 0;
+}